@@ -43,9 +43,60 @@ namespace uwp_midiio
 {
 	using namespace std::chrono_literals;
 	constexpr auto MIDI_PORT_OPEN_TIMEOUT{ 3s };
+	// A disconnected port that reconnects is opened again at least
+	// this often even if the device is not seen coming back.
+	constexpr auto MIDI_PORT_RECONNECT_INTERVAL{ 2s };
 
-	constexpr size_t DEFAULT_MIDI_IN_QUEUE_SIZE{ 8192 };
+	// Ports that can be open at once (for each of MIDI IN and OUT)
+	constexpr size_t MIDI_PORT_HANDLE_SLOTS{ 128 };
+	// Reuses of a slot before a handle of a closed port is accepted again
+	constexpr size_t MIDI_PORT_HANDLE_GENERATIONS{ 16 };
+
+	// Default limit of the MIDI IN queue
 	constexpr size_t MAX_MIDI_IN_QUEUE_SIZE{ 16384 };
+	// Initial size for the `grow` overflow policy
+	constexpr size_t INITIAL_MIDI_IN_QUEUE_SIZE{ 1024 };
+	// Upper bound of the limit that the host can specify
+	constexpr size_t MIDI_QUEUE_SIZE_HARD_LIMIT{ 4 * 1024 * 1024 };
+	constexpr size_t MIDI_IN_SYSEX_ARENA_SIZE{ 128 * 1024 };
+	constexpr auto MIDI_IN_DROP_REPORT_INTERVAL{ 1s };
+	// Maximum number of messages passed to a MIDI IN callback at once
+	constexpr size_t MIDI_IN_CALLBACK_BATCH_SIZE{ 256 };
+
+	// Reusable send buffers of a MIDI OUT port
+	constexpr size_t MIDI_OUT_BUFFER_POOL_SIZE{ 8 };
+	// Initial capacity of each send buffer (grows for longer SysEx)
+	constexpr size_t MIDI_OUT_BUFFER_SIZE{ 256 };
+	// Default size of the asynchronous MIDI OUT queue
+	constexpr size_t MIDI_OUT_QUEUE_SIZE{ 4096 };
+	constexpr size_t MIDI_OUT_SYSEX_ARENA_SIZE{ 128 * 1024 };
+	// Longer SysEx given at once is queued in pieces of this size
+	// so that each piece fits in the arena
+	constexpr size_t MIDI_OUT_SYSEX_PIECE_SIZE{ 16 * 1024 };
+	// Maximum number of messages the sender thread removes at once
+	constexpr size_t MIDI_OUT_SEND_BATCH_SIZE{ 32 };
+	// Maximum size of a write that packs several messages
+	constexpr size_t MIDI_OUT_PACKED_WRITE_SIZE{ 128 };
+	// The sender thread sleeps until this long before the send time
+	// of a scheduled message and then spins (default of
+	// MIDIOut_SetScheduleSpin)
+	constexpr auto MIDI_OUT_SCHEDULE_SPIN_MARGIN{ 1ms };
+	// Timer resolution requested while messages are scheduled
+	constexpr unsigned int MIDI_OUT_TIMER_PERIOD_MS{ 1 };
+	// Bytes that the rate limiter lets through in a burst,
+	// as the time it takes at the limited rate
+	constexpr auto MIDI_OUT_RATE_LIMIT_BURST{ 10ms };
+	constexpr size_t MIDI_OUT_REALTIME_LANE_SIZE{ 256 };
+
+	// Bytes buffered while a port opened asynchronously is connecting
+	// (synchronous mode)
+	constexpr size_t MIDI_OUT_CONNECT_BUFFER_SIZE{ 64 * 1024 };
+
+	// Ports looked up at once by MIDIOut_PutMIDIMessageMulti
+	constexpr size_t MIDI_OUT_MULTI_BATCH_SIZE{ 64 };
+
+	// Shorter byte ranges are scanned for status bytes without SIMD.
+	constexpr size_t MIDI_SCAN_SIMD_MIN_SIZE{ 32 };
 
 	// verbose level
 	// 0: none
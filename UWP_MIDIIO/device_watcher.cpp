@@ -0,0 +1,234 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// device_watcher.cpp:
+//   MIDI device watcher class `device_watcher`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+#include "config.h"
+
+#include "device_watcher.h"
+
+#include "debug_message.h"
+
+using namespace winrt;
+using namespace Windows::Foundation;
+using namespace Windows::Devices::Enumeration;
+using namespace Windows::Devices::Midi;
+
+namespace
+{
+	// A BLE MIDI device that has disconnected keeps its interface,
+	// but the interface is disabled.
+	constexpr wchar_t INTERFACE_ENABLED[]{
+		L"System.Devices.InterfaceEnabled" };
+}
+
+namespace uwp_midiio
+{
+	std::map<size_t, std::shared_ptr<device_watcher::subscriber>>
+		device_watcher::subscribers_;
+	size_t device_watcher::next_token_{ 0 };
+	std::mutex device_watcher::subscribers_mtx_;
+	std::condition_variable device_watcher::subscribers_cv_;
+
+	std::vector<DeviceWatcher> device_watcher::watchers_;
+	std::mutex device_watcher::watchers_mtx_;
+
+	size_t device_watcher::subscribe(callback f)
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		std::lock_guard<std::mutex> watchers_lock(watchers_mtx_);
+
+		if (watchers_.empty() && !start())
+		{
+			DEBUG_MESSAGE_W(L"returns 0\n");
+			return 0;
+		}
+
+		auto s{ std::make_shared<subscriber>(subscriber{ std::move(f) }) };
+
+		std::lock_guard<std::mutex> lock(subscribers_mtx_);
+
+		const auto token{ ++next_token_ };
+		subscribers_.emplace(token, std::move(s));
+
+		DEBUG_MESSAGE_W(L"returns " << token << L", "
+			<< subscribers_.size() << L" subscriber(s)\n");
+		return token;
+	}
+
+	void device_watcher::unsubscribe(size_t token)
+	{
+		DEBUG_MESSAGE_W(L"enter " << token << L"\n");
+
+		{
+			std::unique_lock<std::mutex> lock(subscribers_mtx_);
+
+			const auto it{ subscribers_.find(token) };
+			if (it == subscribers_.end())
+				return;
+			const auto s{ it->second };
+			subscribers_.erase(it);
+
+			// Waits for the calls in progress
+			subscribers_cv_.wait(lock, [&s]
+			{
+				return s->calls == 0;
+			});
+		}
+
+		// subscribe also locks watchers_mtx_ first,
+		// so nobody can subscribe between the check and stop.
+		std::lock_guard<std::mutex> watchers_lock(watchers_mtx_);
+
+		bool empty;
+		{
+			std::lock_guard<std::mutex> lock(subscribers_mtx_);
+
+			empty = subscribers_.empty();
+		}
+		if (empty)
+			stop();
+	}
+
+	bool device_watcher::start()
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		try
+		{
+			watchers_.push_back(watch(MidiInPort::GetDeviceSelector()));
+			watchers_.push_back(watch(MidiOutPort::GetDeviceSelector()));
+		}
+		catch (winrt::hresult_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception 0x"
+				<< std::hex << ex.code()
+				<< L", "
+				<< static_cast<std::wstring_view>(ex.message())
+				<< L"\n");
+
+			stop();
+			return false;
+		}
+
+		return true;
+	}
+
+	void device_watcher::stop()
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		for (const auto& w : watchers_)
+		{
+			try
+			{
+				const auto status{ w.Status() };
+				if (status == DeviceWatcherStatus::Started ||
+					status == DeviceWatcherStatus::EnumerationCompleted)
+					w.Stop();
+			}
+			catch (winrt::hresult_error const& ex)
+			{
+				WARNING_MESSAGE_W(L"exception 0x"
+					<< std::hex << ex.code()
+					<< L", "
+					<< static_cast<std::wstring_view>(ex.message())
+					<< L"\n");
+			}
+		}
+		watchers_.clear();
+	}
+
+	DeviceWatcher device_watcher::watch(winrt::hstring device_selector)
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		auto w{ DeviceInformation::CreateWatcher(device_selector,
+			{ INTERFACE_ENABLED }) };
+
+		// Also called for the devices found when the watcher starts
+		w.Added([](const DeviceWatcher&, const DeviceInformation& info)
+		{
+			const auto enabled{
+				info.Properties().TryLookup(INTERFACE_ENABLED) };
+			notify(info.Id(), unbox_value_or<bool>(enabled, true));
+		});
+		w.Updated([](const DeviceWatcher&,
+			const DeviceInformationUpdate& info)
+		{
+			const auto enabled{
+				info.Properties().TryLookup(INTERFACE_ENABLED) };
+			if (enabled)
+				notify(info.Id(), unbox_value_or<bool>(enabled, true));
+		});
+		w.Removed([](const DeviceWatcher&,
+			const DeviceInformationUpdate& info)
+		{
+			notify(info.Id(), false);
+		});
+		w.Start();
+
+		return w;
+	}
+
+	void device_watcher::notify(std::wstring_view id, bool present)
+	{
+		DEBUG_MESSAGE_W(L"enter \"" << id << L"\", " << present << L"\n");
+
+		// The callbacks are called without the lock
+		// since they may wait for threads that unsubscribe.
+		std::vector<std::shared_ptr<subscriber>> subscribers;
+		{
+			std::lock_guard<std::mutex> lock(subscribers_mtx_);
+
+			subscribers.reserve(subscribers_.size());
+			for (const auto& [token, s] : subscribers_)
+			{
+				++s->calls;
+				subscribers.push_back(s);
+			}
+		}
+
+		for (const auto& s : subscribers)
+		{
+			s->f(id, present);
+			{
+				std::lock_guard<std::mutex> lock(subscribers_mtx_);
+				--s->calls;
+			}
+			subscribers_cv_.notify_all();
+		}
+	}
+}
@@ -0,0 +1,92 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// device_watcher.h:
+//   MIDI device watcher class `device_watcher`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "pch.h"
+
+namespace uwp_midiio
+{
+	// Reports MIDI devices that go and come back.
+	// A BLE device keeps its id when it disconnects and connects again.
+	class device_watcher final
+	{
+	public:
+		// `present` is false when the device has gone.
+		// Called on WinRT threads without holding a lock of the watcher,
+		// possibly from the MIDI IN and OUT watchers at the same time.
+		using callback =
+			std::function<void(std::wstring_view id, bool present)>;
+
+		device_watcher() = delete;
+		~device_watcher() = delete;
+		device_watcher(const device_watcher&) = delete;
+		device_watcher& operator=(const device_watcher&) = delete;
+		device_watcher(device_watcher&&) = delete;
+		device_watcher& operator=(device_watcher&&) = delete;
+
+		// Starts watching with the first subscriber.
+		// Returns the token for unsubscribe, 0 on failure.
+		static size_t subscribe(callback f);
+		// `f` is not called after this returns,
+		// so it must not be called from `f`.
+		// Stops watching with the last subscriber.
+		static void unsubscribe(size_t token);
+
+	private:
+		static bool start();
+		static void stop();
+		static winrt::Windows::Devices::Enumeration::DeviceWatcher
+			watch(winrt::hstring device_selector);
+		static void notify(std::wstring_view id, bool present);
+
+		struct subscriber
+		{
+			const callback f;
+			// Calls in progress, guarded by subscribers_mtx_
+			size_t calls{ 0 };
+		};
+
+		static std::map<size_t, std::shared_ptr<subscriber>> subscribers_;
+		static size_t next_token_;
+		static std::mutex subscribers_mtx_;
+		// Notified when a call has returned
+		static std::condition_variable subscribers_cv_;
+
+		static std::vector<winrt::Windows::Devices::Enumeration::DeviceWatcher>
+			watchers_;
+		static std::mutex watchers_mtx_;
+	};
+}
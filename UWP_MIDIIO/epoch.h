@@ -0,0 +1,135 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// epoch.h:
+//   Epoch-based reclamation `epoch_domain`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+#include "notifier.h"
+#include "spsc_ring.h"  // CACHE_LINE_SIZE
+
+namespace uwp_midiio
+{
+	// Grace periods for objects that lock-free readers may still use.
+	// A reader holds a guard while it uses them.
+	// An updater unlinks an object so that new readers cannot find it,
+	// then calls synchronize, which returns after every guard entered
+	// before the call has been released, so the object can be freed.
+	class epoch_domain final
+	{
+	public:
+		class guard final
+		{
+		public:
+			explicit guard(epoch_domain& domain) :
+				domain_(domain), parity_(domain.enter())
+			{
+			}
+			~guard()
+			{
+				domain_.exit(parity_);
+			}
+
+			guard(const guard&) = delete;
+			guard& operator=(const guard&) = delete;
+			guard(guard&&) = delete;
+			guard& operator=(guard&&) = delete;
+
+		private:
+			epoch_domain& domain_;
+			const size_t parity_;
+		};
+
+		epoch_domain() = default;
+
+		epoch_domain(const epoch_domain&) = delete;
+		epoch_domain& operator=(const epoch_domain&) = delete;
+		epoch_domain(epoch_domain&&) = delete;
+		epoch_domain& operator=(epoch_domain&&) = delete;
+
+		// Must not be called while holding a guard of the same domain.
+		void synchronize()
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+
+			// Readers count themselves in the parity of the epoch they saw.
+			// After two advances, both parities have drained once
+			// since the call, including a reader that saw the epoch
+			// just before the first advance.
+			for (int i = 0; i < 2; ++i)
+			{
+				const auto old{ epoch_.fetch_add(1) };
+				const auto& active{ active_[old & 1].count };
+				drained_.wait([&active] { return active.load() == 0; });
+			}
+		}
+
+	private:
+		size_t enter()
+		{
+			for (;;)
+			{
+				const auto e{ epoch_.load() };
+				active_[e & 1].count.fetch_add(1);
+				// The epoch did not advance in between,
+				// so synchronize sees this reader.
+				if (epoch_.load() == e)
+					return e & 1;
+				exit(e & 1);
+			}
+		}
+		void exit(size_t parity)
+		{
+			// Only the last reader of a parity can end a wait.
+			if (active_[parity].count.fetch_sub(1,
+				std::memory_order_release) == 1)
+				drained_.notify();
+		}
+
+		struct alignas(CACHE_LINE_SIZE) counter
+		{
+			std::atomic<size_t> count{ 0 };
+		};
+
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> epoch_{ 0 };
+		std::array<counter, 2> active_;
+		std::mutex mtx_;
+		// Wakes up synchronize when the readers of a parity have left
+		notifier drained_;
+	};
+}
@@ -0,0 +1,162 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// handle_table.h:
+//   Handle table `handle_table`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "pch.h"
+
+namespace uwp_midiio
+{
+	// Registry of open ports behind the MIDIIn* / MIDIOut* handles.
+	// A handle points to a MIDIIO struct in the table itself, so hosts can
+	// read it as with MIDIIO.dll, and looking it up is a range check and
+	// one atomic load without a lock.
+	// Each of the `SLOTS` slots has `GENERATIONS` structs and hands out
+	// the next one each time it is reused, and freed slots are reused
+	// in FIFO order, so a handle of a closed port is rejected until its
+	// slot has been reused `GENERATIONS` times.
+	// The table owns the ports.
+	template<class Port_T, class MidiIO_T, size_t SLOTS, size_t GENERATIONS>
+	class handle_table final
+	{
+		struct entry
+		{
+			MidiIO_T handle;
+			std::atomic<Port_T*> port{ nullptr };
+		};
+
+	public:
+		handle_table()
+		{
+			for (size_t i = 0; i < SLOTS; ++i)
+				free_[i] = i;
+		}
+		~handle_table()
+		{
+			for (auto& e : entries_)
+				delete e.port.exchange(nullptr);
+		}
+
+		handle_table(const handle_table&) = delete;
+		handle_table& operator=(const handle_table&) = delete;
+		handle_table(handle_table&&) = delete;
+		handle_table& operator=(handle_table&&) = delete;
+
+		// Takes the ownership of `port`.
+		// Returns nullptr (`port` is not taken) if all slots are in use.
+		MidiIO_T* insert(std::unique_ptr<Port_T>& port)
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+
+			if (free_count_ == 0)
+				return nullptr;
+			const auto slot{ free_[free_head_] };
+			free_head_ = (free_head_ + 1) % SLOTS;
+			--free_count_;
+
+			auto& e{ entries_[slot * GENERATIONS +
+				generations_[slot] % GENERATIONS] };
+			e.handle.m_pDeviceName = port->m_pDeviceName;
+			e.port.store(port.release(), std::memory_order_release);
+			return &e.handle;
+		}
+
+		// Returns nullptr if `handle` is not open.
+		Port_T* find(const MidiIO_T* handle) const
+		{
+			const auto index{ index_of(handle) };
+			if (index == NPOS)
+				return nullptr;
+			return entries_[index].port.load(std::memory_order_acquire);
+		}
+
+		// Returns the port removed (nullptr if `handle` is not open).
+		std::unique_ptr<Port_T> erase(const MidiIO_T* handle)
+		{
+			const auto index{ index_of(handle) };
+			if (index == NPOS)
+				return nullptr;
+
+			std::lock_guard<std::mutex> lock(mtx_);
+
+			auto& e{ entries_[index] };
+			std::unique_ptr<Port_T> port{
+				e.port.exchange(nullptr, std::memory_order_acq_rel) };
+			if (!port)
+				return nullptr;
+			e.handle.m_pDeviceName = nullptr;
+
+			const auto slot{ index / GENERATIONS };
+			++generations_[slot];
+			free_[(free_head_ + free_count_) % SLOTS] = slot;
+			++free_count_;
+			return port;
+		}
+
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			return SLOTS - free_count_;
+		}
+
+	private:
+		static constexpr size_t NPOS{ static_cast<size_t>(-1) };
+
+		// Checks the address only, `handle` is never dereferenced.
+		size_t index_of(const MidiIO_T* handle) const
+		{
+			const auto address{ reinterpret_cast<uintptr_t>(handle) };
+			const auto base{
+				reinterpret_cast<uintptr_t>(&entries_[0].handle) };
+			if (address < base)
+				return NPOS;
+
+			const auto offset{ address - base };
+			if (offset % sizeof(entry) != 0 ||
+				offset / sizeof(entry) >= entries_.size())
+				return NPOS;
+			return offset / sizeof(entry);
+		}
+
+		std::array<entry, SLOTS * GENERATIONS> entries_;
+
+		// Guarded by mtx_
+		mutable std::mutex mtx_;
+		std::array<size_t, SLOTS> generations_{};
+		std::array<size_t, SLOTS> free_{};
+		size_t free_head_{ 0 };
+		size_t free_count_{ SLOTS };
+	};
+}
@@ -0,0 +1,61 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_clock.h:
+//   Clock shared with the host
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "pch.h"
+
+namespace uwp_midiio
+{
+	// Timestamps exchanged with the host are microseconds on
+	// std::chrono::steady_clock, which is QueryPerformanceCounter on MSVC.
+	using midi_clock = std::chrono::steady_clock;
+
+	inline long long to_host_time(midi_clock::time_point tp)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			tp.time_since_epoch()).count();
+	}
+	inline midi_clock::time_point from_host_time(long long t)
+	{
+		return midi_clock::time_point{
+			std::chrono::duration_cast<midi_clock::duration>(
+				std::chrono::microseconds{ t }) };
+	}
+	inline long long host_time_now()
+	{
+		return to_host_time(midi_clock::now());
+	}
+}
@@ -0,0 +1,246 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_in_connection.cpp:
+//   Shared MIDI IN device connection class `midi_in_connection`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+#include "config.h"
+
+#include "midi_in_connection.h"
+
+#include "debug_message.h"
+#include "midi_port_in.h"
+
+using namespace winrt;
+using namespace Windows::Foundation;
+using namespace Windows::Devices::Midi;
+
+namespace uwp_midiio
+{
+	std::map<std::wstring, std::weak_ptr<midi_in_connection>, std::less<>>
+		midi_in_connection::connections_;
+	std::mutex midi_in_connection::connections_mtx_;
+
+	midi_in_connection::midi_in_connection(MidiInPort port) :
+		port_(std::move(port))
+	{
+		DEBUG_MESSAGE_W(L"  trying MessageReceived\n");
+		try
+		{
+			before_token_ = port_.MessageReceived(
+				{ this, &midi_in_connection::midi_in_callback });
+			DEBUG_MESSAGE_W(L"  before_token is "
+				<< static_cast<bool>(before_token_)
+				<< L" (value = "
+				<< before_token_.value
+				<< L")\n");
+		}
+		catch (winrt::hresult_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception 0x"
+				<< std::hex << ex.code()
+				<< L", "
+				<< static_cast<std::wstring_view>(ex.message())
+				<< L"\n");
+		}
+	}
+
+	midi_in_connection::~midi_in_connection()
+	{
+		if (before_token_)
+			port_.MessageReceived(before_token_);
+		delete ports_.load(std::memory_order_relaxed);
+	}
+
+	std::shared_ptr<midi_in_connection> midi_in_connection::acquire(
+		std::wstring_view id)
+	{
+		DEBUG_MESSAGE_W(L"enter \"" << id << L"\"\n");
+
+		{
+			std::lock_guard<std::mutex> lock(connections_mtx_);
+
+			auto it{ connections_.find(id) };
+			if (it != connections_.end())
+			{
+				if (auto c{ it->second.lock() })
+				{
+					DEBUG_MESSAGE_W(L"returns the existing connection\n");
+					return c;
+				}
+			}
+		}
+
+		// Opening takes time, so other ports can be opened meanwhile.
+		auto port{ uwp_midiio_port_in::open_port(id) };
+		if (!port)
+		{
+			DEBUG_MESSAGE_W(L"returns nullptr\n");
+			return nullptr;
+		}
+		auto c{ std::make_shared<midi_in_connection>(std::move(port)) };
+		if (!c->before_token_)
+		{
+			DEBUG_MESSAGE_W(L"returns nullptr\n");
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(connections_mtx_);
+
+		// Another thread might have connected the same device meanwhile.
+		auto& w{ connections_[std::wstring(id)] };
+		if (auto existing{ w.lock() })
+		{
+			DEBUG_MESSAGE_W(L"returns the existing connection\n");
+			return existing;
+		}
+		w = c;
+
+		// Remove the entries of closed connections
+		for (auto it = connections_.begin(); it != connections_.end();)
+		{
+			if (it->second.expired())
+				it = connections_.erase(it);
+			else
+				++it;
+		}
+
+		DEBUG_MESSAGE_W(L"returns a new connection, "
+			<< connections_.size()
+			<< L" connection(s)\n");
+		return c;
+	}
+
+	void midi_in_connection::forget(const midi_in_connection* c)
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		std::lock_guard<std::mutex> lock(connections_mtx_);
+
+		// Another port might have opened the device again already.
+		for (auto it = connections_.begin(); it != connections_.end(); ++it)
+		{
+			if (it->second.lock().get() == c)
+			{
+				connections_.erase(it);
+				break;
+			}
+		}
+	}
+
+	void midi_in_connection::attach(uwp_midiio_port_in* p)
+	{
+		std::lock_guard<std::mutex> lock(ports_mtx_);
+
+		auto ports{ std::make_unique<port_list>(
+			*ports_.load(std::memory_order_relaxed)) };
+		ports->push_back(p);
+		replace_ports(std::move(ports));
+	}
+
+	void midi_in_connection::detach(uwp_midiio_port_in* p)
+	{
+		// After this returns, midi_in_callback does not touch `p`.
+		std::lock_guard<std::mutex> lock(ports_mtx_);
+
+		auto ports{ std::make_unique<port_list>(
+			*ports_.load(std::memory_order_relaxed)) };
+		ports->erase(std::remove(ports->begin(), ports->end(), p),
+			ports->end());
+		replace_ports(std::move(ports));
+	}
+
+	void midi_in_connection::replace_ports(std::unique_ptr<port_list> ports)
+	{
+		const std::unique_ptr<port_list> old{
+			ports_.exchange(ports.release(), std::memory_order_acq_rel) };
+
+		// midi_in_callback might still be reading the old list.
+		ports_epoch_.synchronize();
+	}
+
+	void midi_in_connection::midi_in_callback(const MidiInPort&,
+		const MidiMessageReceivedEventArgs& e)
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		const auto received{ midi_clock::now() };
+
+		try
+		{
+			const auto message{ e.Message() };
+			const auto raw_data{ message.RawData() };
+			const auto timestamp
+				{ convert_timestamp(message.Timestamp(), received) };
+
+			epoch_domain::guard guard{ ports_epoch_ };
+
+			for (auto p : *ports_.load(std::memory_order_acquire))
+				p->receive(raw_data.data(), raw_data.Length(), timestamp);
+		}
+		catch (winrt::hresult_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception 0x"
+				<< std::hex << ex.code()
+				<< L", "
+				<< static_cast<std::wstring_view>(ex.message())
+				<< L"\n");
+		}
+
+		DEBUG_MESSAGE_W(L"returns\n");
+	}
+
+	long long midi_in_connection::convert_timestamp(TimeSpan timestamp,
+		midi_clock::time_point received)
+	{
+		// `timestamp` is the time since the port was created.
+		// Messages are always delivered after they are received,
+		// so the smallest difference seen so far is the best estimate
+		// of the port creation time on midi_clock.
+		const auto offset{ received.time_since_epoch() -
+			std::chrono::duration_cast<midi_clock::duration>(timestamp) };
+		if (offset < timestamp_offset_)
+			timestamp_offset_ = offset;
+
+		auto retval{ to_host_time(midi_clock::time_point{
+			std::chrono::duration_cast<midi_clock::duration>(timestamp) +
+			timestamp_offset_ }) };
+
+		// Keep timestamps monotonic when the estimate is refined
+		if (retval < last_timestamp_)
+			retval = last_timestamp_;
+		last_timestamp_ = retval;
+
+		return retval;
+	}
+}
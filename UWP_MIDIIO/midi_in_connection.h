@@ -0,0 +1,110 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_in_connection.h:
+//   Shared MIDI IN device connection class `midi_in_connection`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "pch.h"
+#include "config.h"
+
+#include "epoch.h"
+#include "midi_clock.h"
+
+namespace uwp_midiio
+{
+	class uwp_midiio_port_in;
+
+	// One WinRT MidiInPort per device id, shared by all MIDI IN ports
+	// opened for the device.
+	// Received messages are fanned out to the queues of the ports.
+	class midi_in_connection final
+	{
+	public:
+		explicit midi_in_connection(
+			winrt::Windows::Devices::Midi::MidiInPort port);
+		~midi_in_connection();
+
+		midi_in_connection(const midi_in_connection&) = delete;
+		midi_in_connection& operator=(const midi_in_connection&) = delete;
+		midi_in_connection(midi_in_connection&&) = delete;
+		midi_in_connection& operator=(midi_in_connection&&) = delete;
+
+		// Returns the connection for `id`, opening the device
+		// if it is not connected yet. Returns nullptr on failure.
+		static std::shared_ptr<midi_in_connection> acquire(
+			std::wstring_view id);
+		// The device of `c` has disconnected.
+		// The next acquire opens the device again.
+		static void forget(const midi_in_connection* c);
+
+		winrt::Windows::Devices::Midi::MidiInPort& port()
+		{
+			return port_;
+		}
+
+		void attach(uwp_midiio_port_in* p);
+		void detach(uwp_midiio_port_in* p);
+
+	private:
+		using port_list = std::vector<uwp_midiio_port_in*>;
+
+		void replace_ports(std::unique_ptr<port_list> ports);
+		void midi_in_callback(
+			const winrt::Windows::Devices::Midi::MidiInPort&,
+			const winrt::Windows::Devices::Midi::MidiMessageReceivedEventArgs&
+			e);
+		long long convert_timestamp(
+			winrt::Windows::Foundation::TimeSpan timestamp,
+			midi_clock::time_point received);
+
+		static std::map<std::wstring, std::weak_ptr<midi_in_connection>,
+			std::less<>> connections_;
+		static std::mutex connections_mtx_;
+
+		winrt::Windows::Devices::Midi::MidiInPort port_;
+		winrt::event_token before_token_;
+
+		// Ports that receive the messages
+		// midi_in_callback reads the list without locking.
+		// attach and detach replace it under ports_mtx_
+		// and free the old one after the readers have left ports_epoch_.
+		std::atomic<port_list*> ports_{ new port_list };
+		std::mutex ports_mtx_;
+		epoch_domain ports_epoch_;
+
+		// Used by midi_in_callback only
+		midi_clock::duration timestamp_offset_{ midi_clock::duration::max() };
+		long long last_timestamp_{ 0 };
+	};
+}
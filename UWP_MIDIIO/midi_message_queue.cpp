@@ -0,0 +1,469 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_message_queue.cpp:
+//   MIDI message queue class `midi_message_queue`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+#include "config.h"
+
+#include "midi_message_queue.h"
+
+namespace uwp_midiio
+{
+	namespace
+	{
+		size_t initial_capacity(size_t limit,
+			midi_message_queue::overflow_policy policy)
+		{
+			switch (policy)
+			{
+			case midi_message_queue::overflow_policy::drop_newest:
+				return limit;
+			case midi_message_queue::overflow_policy::grow:
+				return std::min(limit, INITIAL_MIDI_IN_QUEUE_SIZE);
+			default:
+				// The consumer trims the oldest messages (drop_oldest)
+				// or realtime and SysEx use the rest (keep_realtime_sysex).
+				return limit * 2;
+			}
+		}
+
+		bool is_realtime_or_sysex(const unsigned char* data, size_t len)
+		{
+			return len > 0 && (data[0] == 0xf0 || data[0] >= 0xf8);
+		}
+
+		// Controllers whose order relative to other messages matters
+		// (bank select, data entry, switches, RPN/NRPN, channel mode)
+		// are not coalesced.
+		constexpr bool is_continuous_controller(unsigned char cc)
+		{
+			return !(cc == 0 || cc == 6 || cc == 32 || cc == 38 ||
+				(cc >= 64 && cc <= 69) ||
+				(cc >= 96 && cc <= 101) ||
+				cc >= 120);
+		}
+
+		constexpr int COALESCE_KEYS_PER_CHANNEL{ 128 + 2 };
+		constexpr int COALESCE_KEYS{ 16 * COALESCE_KEYS_PER_CHANNEL };
+
+		// Returns -1 if the message is not coalesced
+		int coalesce_key(const unsigned char* data, size_t len)
+		{
+			if (len < 2)
+				return -1;
+
+			const auto channel{ data[0] & 0x0f };
+			switch (data[0] & 0xf0)
+			{
+			case 0xb0:
+				if (len == 3 && is_continuous_controller(data[1]))
+					return channel * COALESCE_KEYS_PER_CHANNEL + data[1];
+				break;
+			case 0xe0:
+				if (len == 3)
+					return channel * COALESCE_KEYS_PER_CHANNEL + 128;
+				break;
+			case 0xd0:
+				if (len == 2)
+					return channel * COALESCE_KEYS_PER_CHANNEL + 129;
+				break;
+			}
+			return -1;
+		}
+	}
+
+	midi_message_queue::midi_message_queue(size_t limit,
+		size_t arena_size, overflow_policy policy) :
+		policy_(policy),
+		limit_(limit),
+		arena_size_(static_cast<uint32_t>(round_up_power_of_two(arena_size))),
+		arena_mask_(arena_size_ - 1),
+		// A message that crosses the end of the arena is stored
+		// contiguously in the second half instead of being wrapped,
+		// so that the consumer can always read it in one piece.
+		arena_(std::make_unique<unsigned char[]>(arena_size_ * 2)),
+		head_segment_(new segment(initial_capacity(limit, policy), 1)),
+		tail_segment_(head_segment_)
+	{
+	}
+
+	midi_message_queue::~midi_message_queue()
+	{
+		auto s{ head_segment_ };
+		while (s)
+		{
+			auto next{ s->next.load(std::memory_order_acquire) };
+			delete s;
+			s = next;
+		}
+	}
+
+	void midi_message_queue::set_coalesce_threshold(size_t threshold)
+	{
+		{
+			std::lock_guard<std::mutex> lock(coalesce_mtx_);
+
+			if (threshold && !coalesce_table_)
+				coalesce_table_ =
+					std::make_unique<coalesce_record[]>(COALESCE_KEYS);
+		}
+
+		coalesce_threshold_.store(threshold, std::memory_order_release);
+	}
+
+	bool midi_message_queue::push(const unsigned char* data, size_t len,
+		long long timestamp)
+	{
+		const auto threshold
+			{ coalesce_threshold_.load(std::memory_order_acquire) };
+		const auto key{ threshold ? coalesce_key(data, len) : -1 };
+		uint32_t short_data{ 0 };
+		if (len <= SHORT_MESSAGE_SIZE)
+			std::memcpy(&short_data, data, len);
+
+		if (key >= 0 && backlog_reaches(threshold) &&
+			coalesce(key, short_data, timestamp))
+			return true;
+
+		if (!admit(data, len))
+		{
+			drop(1, len);
+			return false;
+		}
+
+		auto end{ arena_tail_ };
+		if (len > SHORT_MESSAGE_SIZE)
+		{
+			const auto position{ arena_tail_ };
+			end = static_cast<uint32_t>(position + len);
+			if (len > arena_size_ || end - cached_arena_head_ > arena_size_)
+			{
+				cached_arena_head_ =
+					arena_head_.load(std::memory_order_acquire);
+				if (len > arena_size_ ||
+					(end - cached_arena_head_ > arena_size_ &&
+					!evict_oldest(limit_, end)))
+				{
+					drop(1, len);
+					return false;
+				}
+				cached_arena_head_ =
+					arena_head_.load(std::memory_order_acquire);
+			}
+
+			std::memcpy(&arena_[position & arena_mask_], data, len);
+			short_data = position;
+		}
+
+		const auto entries{ writable_entries() };
+		auto e{ entries ? entries->reserve() : nullptr };
+		if (!e && evict_oldest(limit_, arena_tail_))
+			e = entries->reserve();
+		if (!e)
+		{
+			drop(1, len);
+			return false;
+		}
+
+		e->length = static_cast<uint32_t>(len);
+		e->data.store(short_data, std::memory_order_relaxed);
+		e->timestamp.store(timestamp, std::memory_order_relaxed);
+		entries->commit();
+
+		const auto pushed{ pushed_.load(std::memory_order_relaxed) };
+		if (key >= 0)
+			coalesce_table_[key] =
+				{ tail_segment_->serial, e, pushed, short_data };
+
+		arena_tail_ = end;
+		pushed_.store(pushed + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool midi_message_queue::admit(const unsigned char* data, size_t len)
+	{
+		switch (policy_)
+		{
+		case overflow_policy::drop_newest:
+			// Not by the ring buffer capacity,
+			// which is rounded up to a power of two
+			return !backlog_reaches(limit_);
+		case overflow_policy::keep_realtime_sysex:
+		case overflow_policy::grow:
+			break;
+		default:
+			// The oldest messages are trimmed instead.
+			return true;
+		}
+
+		if (!backlog_reaches(limit_))
+			return true;
+
+		return policy_ == overflow_policy::keep_realtime_sysex &&
+			is_realtime_or_sysex(data, len);
+	}
+
+	bool midi_message_queue::backlog_reaches(size_t n)
+	{
+		const auto pushed{ pushed_.load(std::memory_order_relaxed) };
+		if (pushed - cached_popped_ < n)
+			return false;
+
+		cached_popped_ = popped_.load(std::memory_order_acquire);
+		return pushed - cached_popped_ >= n;
+	}
+
+	bool midi_message_queue::coalesce(int key, uint32_t data,
+		long long timestamp)
+	{
+		auto& r{ coalesce_table_[key] };
+
+		// The slot has not been reused if it is in the current segment
+		// and fewer pushes than the capacity have happened since.
+		// (Records of a deleted segment never match a new one
+		// even at the same address.)
+		if (r.segment_serial != tail_segment_->serial ||
+			pushed_.load(std::memory_order_relaxed) - r.sequence >=
+			tail_segment_->entries.capacity())
+			return false;
+
+		// Fails if the consumer has already taken the bytes.
+		// The timestamp cannot be replaced atomically with them:
+		// storing it first would give the old bytes the new timestamp
+		// if the consumer took them in between, so it is stored after
+		// and may lag by one update instead (see uwp_midiio.h).
+		auto expected{ r.data };
+		if (!r.e->data.compare_exchange_strong(expected, data,
+			std::memory_order_release, std::memory_order_relaxed))
+			return false;
+
+		r.e->timestamp.store(timestamp, std::memory_order_relaxed);
+		r.data = data;
+		coalesced_messages_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	spsc_ring<midi_message_queue::entry>*
+		midi_message_queue::writable_entries()
+	{
+		auto& entries{ tail_segment_->entries };
+		if (policy_ != overflow_policy::grow ||
+			entries.size() < entries.capacity() ||
+			entries.capacity() >= limit_)
+			return &entries;
+
+		segment* s;
+		try
+		{
+			s = new segment(std::min(entries.capacity() * 2, limit_),
+				segment_serial_ + 1);
+		}
+		catch (std::bad_alloc&)
+		{
+			return nullptr;
+		}
+		++segment_serial_;
+		tail_segment_->next.store(s, std::memory_order_release);
+		tail_segment_ = s;
+
+		return &s->entries;
+	}
+
+	void midi_message_queue::drop(size_t count, size_t bytes)
+	{
+		dropped_messages_.fetch_add(count, std::memory_order_relaxed);
+		dropped_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	// The consumer would trim the oldest messages the next time it reads,
+	// but the arriving ones must not be dropped if it does not read
+	// for a while.
+	bool midi_message_queue::evict_oldest(size_t keep, uint32_t arena_end)
+	{
+		if (policy_ != overflow_policy::drop_oldest)
+			return false;
+
+		// drop_oldest uses a single segment.
+		// Only from the head of the ring, while the consumer has not
+		// claimed any message; otherwise the arriving one is dropped
+		// and the consumer trims the oldest ones.
+		auto& entries{ tail_segment_->entries };
+		auto first{ entries.head() };
+		if (claimed_.load(std::memory_order_acquire) != first)
+			return false;
+
+		const auto available{ entries.tail() - first };
+		auto arena_head{ arena_head_.load(std::memory_order_acquire) };
+		size_t count{ 0 };
+		while (count < available &&
+			(available - count > keep || arena_end - arena_head > arena_size_))
+		{
+			const auto& e{ entries.at(first + count) };
+			if (e.length > SHORT_MESSAGE_SIZE)
+				arena_head = static_cast<uint32_t>(
+					e.data.load(std::memory_order_relaxed) + e.length);
+			++count;
+		}
+		if (count == 0)
+			return arena_end - arena_head <= arena_size_;
+
+		// Fails if the consumer has claimed them meanwhile
+		if (!claimed_.compare_exchange_strong(first, first + count,
+			std::memory_order_acq_rel, std::memory_order_relaxed))
+			return false;
+
+		trim(entries, first, count);
+		return arena_end - arena_head_.load(std::memory_order_acquire) <=
+			arena_size_;
+	}
+
+	spsc_ring<midi_message_queue::entry>&
+		midi_message_queue::readable_entries()
+	{
+		while (head_segment_->entries.empty())
+		{
+			auto next{ head_segment_->next.load(std::memory_order_acquire) };
+			if (!next)
+				break;
+
+			// The producer does not push to a segment any more
+			// once it has linked the next one.
+			if (!head_segment_->entries.empty())
+				break;
+
+			delete head_segment_;
+			head_segment_ = next;
+		}
+
+		auto& entries{ head_segment_->entries };
+		if (policy_ == overflow_policy::drop_oldest)
+		{
+			auto first{ claimed_.load(std::memory_order_acquire) };
+			for (;;)
+			{
+				const auto count{ entries.tail() - first };
+				if (count <= limit_)
+					break;
+				if (claimed_.compare_exchange_weak(first,
+					first + count - limit_,
+					std::memory_order_acquire, std::memory_order_acquire))
+				{
+					trim(entries, first, count - limit_);
+					break;
+				}
+			}
+		}
+
+		return entries;
+	}
+
+	midi_message_queue::claimed midi_message_queue::claim(
+		spsc_ring<entry>& entries, size_t max_count)
+	{
+		if (policy_ != overflow_policy::drop_oldest)
+		{
+			const auto first{ entries.head() };
+			return { first, std::min(entries.tail() - first, max_count) };
+		}
+
+		auto first{ claimed_.load(std::memory_order_acquire) };
+		for (;;)
+		{
+			const auto count{ std::min(entries.tail() - first, max_count) };
+			if (count == 0 ||
+				claimed_.compare_exchange_weak(first, first + count,
+					std::memory_order_acquire, std::memory_order_acquire))
+				return { first, count };
+		}
+	}
+
+	void midi_message_queue::release(spsc_ring<entry>& entries, claimed r,
+		size_t count)
+	{
+		// The producer does not remove claimed messages,
+		// so nobody else has changed claimed_.
+		if (count < r.count && policy_ == overflow_policy::drop_oldest)
+			claimed_.store(r.first + count, std::memory_order_release);
+
+		remove(entries, r.first, count);
+	}
+
+	void midi_message_queue::trim(spsc_ring<entry>& entries, size_t first,
+		size_t count)
+	{
+		size_t bytes{ 0 };
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto& e{ entries.at(first + i) };
+			if (e.length <= SHORT_MESSAGE_SIZE)
+				e.data.exchange(0, std::memory_order_acquire);
+			bytes += e.length;
+		}
+
+		remove(entries, first, count);
+		drop(count, bytes);
+	}
+
+	void midi_message_queue::remove(spsc_ring<entry>& entries, size_t first,
+		size_t count)
+	{
+		if (count == 0)
+			return;
+
+		// The arena is released up to the end of the last long message.
+		for (auto i = count; i > 0; --i)
+		{
+			const auto& e{ entries.at(first + i - 1) };
+			if (e.length > SHORT_MESSAGE_SIZE)
+			{
+				const auto end{ static_cast<uint32_t>(
+					e.data.load(std::memory_order_relaxed) + e.length) };
+				// Never goes back even if the other side has released
+				// newer messages first (drop_oldest)
+				auto head{ arena_head_.load(std::memory_order_relaxed) };
+				while (static_cast<int32_t>(end - head) > 0 &&
+					!arena_head_.compare_exchange_weak(head, end,
+						std::memory_order_release, std::memory_order_relaxed))
+				{
+				}
+				break;
+			}
+		}
+
+		// Both sides remove disjoint ranges from the head of the ring,
+		// so the lengths can be added in any order.
+		entries.release_front(count);
+		popped_.fetch_add(count, std::memory_order_release);
+	}
+}
@@ -0,0 +1,270 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_message_queue.h:
+//   MIDI message queue class `midi_message_queue`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "pch.h"
+
+#include "spsc_ring.h"
+
+namespace uwp_midiio
+{
+	// Lock-free single-producer/single-consumer queue of raw MIDI messages.
+	// Short messages are stored in the fixed-size slot itself,
+	// longer ones (SysEx) are copied into a preallocated byte arena.
+	class midi_message_queue final
+	{
+		static constexpr size_t SHORT_MESSAGE_SIZE{ 4 };
+
+		struct entry
+		{
+			uint32_t length;
+			// Bytes of a short message (length <= SHORT_MESSAGE_SIZE),
+			// or the position in the arena.
+			// The consumer takes the bytes by exchanging them with 0
+			// so that the producer can replace them safely (coalescing).
+			std::atomic<uint32_t> data;
+			std::atomic<long long> timestamp;
+		};
+
+		// The producer links a new segment when the current one is full
+		// (overflow_policy::grow only).
+		// The consumer deletes a segment after it has been drained.
+		struct segment
+		{
+			segment(size_t capacity, size_t serial) :
+				entries(capacity),
+				serial(serial)
+			{
+			}
+
+			spsc_ring<entry> entries;
+			// Unique even if a new segment reuses the address
+			// of a deleted one
+			const size_t serial;
+			std::atomic<segment*> next{ nullptr };
+		};
+
+		// The latest queued message for each continuous controller
+		struct coalesce_record
+		{
+			size_t segment_serial;
+			entry* e;
+			size_t sequence;
+			uint32_t data;
+		};
+
+	public:
+		// What happens when `limit` messages are already queued
+		enum class overflow_policy
+		{
+			drop_oldest,  // oldest messages are dropped when the consumer
+			              // reads, or by the producer if it is not
+			              // reading when `limit` * 2 are queued
+			drop_newest,  // arriving messages are dropped
+			keep_realtime_sysex,  // arriving channel messages etc. are
+			                      // dropped, realtime and SysEx are kept
+			grow,  // grows from INITIAL_MIDI_IN_QUEUE_SIZE up to `limit`,
+			       // then arriving messages are dropped
+		};
+
+		midi_message_queue(size_t limit, size_t arena_size,
+			overflow_policy policy);
+		~midi_message_queue();
+
+		midi_message_queue(const midi_message_queue&) = delete;
+		midi_message_queue& operator=(const midi_message_queue&) = delete;
+		midi_message_queue(midi_message_queue&&) = delete;
+		midi_message_queue& operator=(midi_message_queue&&) = delete;
+
+		// Producer side
+		// Returns false if the message is dropped.
+		bool push(const unsigned char* data, size_t len,
+			long long timestamp);
+
+		// Consumer side
+		// Calls `f(data, len, timestamp)` for up to `max_count` messages
+		// in order and removes them from the queue at once.
+		// Stops at the first message for which `f` returns false
+		// (that message is not removed).
+		// Returns the number of removed messages.
+		template<class F>
+		size_t consume(size_t max_count, F&& f)
+		{
+			auto& entries{ readable_entries() };
+			const auto r{ claim(entries, max_count) };
+			size_t i{ 0 };
+
+			for (; i < r.count; ++i)
+			{
+				auto& e{ entries.at(r.first + i) };
+				const auto len{ static_cast<size_t>(e.length) };
+
+				if (len > SHORT_MESSAGE_SIZE)
+				{
+					if (!f(&arena_[e.data.load(std::memory_order_relaxed) &
+						arena_mask_], len,
+						e.timestamp.load(std::memory_order_relaxed)))
+						break;
+					continue;
+				}
+
+				const auto data{ e.data.exchange(0,
+					std::memory_order_acquire) };
+				unsigned char bytes[SHORT_MESSAGE_SIZE];
+				std::memcpy(bytes, &data, sizeof(bytes));
+				if (!f(bytes, len,
+					e.timestamp.load(std::memory_order_relaxed)))
+				{
+					e.data.store(data, std::memory_order_relaxed);
+					break;
+				}
+			}
+
+			release(entries, r, i);
+			return i;
+		}
+
+		// Returns the length of the oldest message, 0 if there is none.
+		size_t front_length()
+		{
+			auto& entries{ readable_entries() };
+			const auto r{ claim(entries, 1) };
+			const auto len{ r.count ? entries.at(r.first).length : 0 };
+			release(entries, r, 0);
+			return len;
+		}
+		// Sequence number of the oldest message
+		// (increases by 1 for each message removed).
+		size_t front_sequence() const
+		{
+			return popped_.load(std::memory_order_relaxed);
+		}
+
+		// Either side
+		size_t size() const
+		{
+			return pushed_.load(std::memory_order_acquire) -
+				popped_.load(std::memory_order_acquire);
+		}
+		bool empty() const
+		{
+			return size() == 0;
+		}
+		unsigned long long dropped_messages() const
+		{
+			return dropped_messages_.load(std::memory_order_relaxed);
+		}
+		unsigned long long dropped_bytes() const
+		{
+			return dropped_bytes_.load(std::memory_order_relaxed);
+		}
+		unsigned long long coalesced_messages() const
+		{
+			return coalesced_messages_.load(std::memory_order_relaxed);
+		}
+
+		// Once `threshold` messages are queued, an arriving continuous
+		// controller, pitch bend or channel pressure message replaces
+		// the queued one of the same channel/controller in place.
+		// The timestamp is replaced after the bytes, so the consumer
+		// may read the new bytes with the previous timestamp.
+		// 0 disables it.
+		void set_coalesce_threshold(size_t threshold);
+
+	private:
+		// Messages taken by the consumer to read
+		// (indexes in the ring of the head segment)
+		struct claimed
+		{
+			size_t first;
+			size_t count;
+		};
+
+		// Producer side
+		bool admit(const unsigned char* data, size_t len);
+		bool backlog_reaches(size_t n);
+		bool coalesce(int key, uint32_t data, long long timestamp);
+		spsc_ring<entry>* writable_entries();
+		void drop(size_t count, size_t bytes);
+		bool evict_oldest(size_t keep, uint32_t arena_end);
+
+		// Consumer side
+		spsc_ring<entry>& readable_entries();
+		claimed claim(spsc_ring<entry>& entries, size_t max_count);
+		// Removes the first `count` claimed messages
+		// and gives the rest back.
+		void release(spsc_ring<entry>& entries, claimed r, size_t count);
+
+		// Either side (the producer in evict_oldest)
+		void trim(spsc_ring<entry>& entries, size_t first, size_t count);
+		void remove(spsc_ring<entry>& entries, size_t first, size_t count);
+
+		const overflow_policy policy_;
+		const size_t limit_;
+
+		const uint32_t arena_size_;
+		const uint32_t arena_mask_;
+		const std::unique_ptr<unsigned char[]> arena_;
+
+		// Written by the consumer only
+		alignas(CACHE_LINE_SIZE) segment* head_segment_;
+		// Written by both sides with drop_oldest:
+		// the producer removes the oldest messages by a CAS on claimed_
+		// when the consumer has not claimed any (claimed_ == the head
+		// of the ring), so that neither side waits for the other.
+		std::atomic<size_t> claimed_{ 0 };
+		std::atomic<size_t> popped_{ 0 };
+		std::atomic<uint32_t> arena_head_{ 0 };
+
+		// Written by the producer only
+		alignas(CACHE_LINE_SIZE) segment* tail_segment_;
+		std::atomic<size_t> pushed_{ 0 };
+		size_t cached_popped_{ 0 };
+		size_t segment_serial_{ 1 };
+		uint32_t arena_tail_{ 0 };
+		uint32_t cached_arena_head_{ 0 };
+		std::atomic<size_t> coalesce_threshold_{ 0 };
+		std::unique_ptr<coalesce_record[]> coalesce_table_;
+
+		// Written by both sides only when messages are dropped
+		alignas(CACHE_LINE_SIZE)
+			std::atomic<unsigned long long> dropped_messages_{ 0 };
+		std::atomic<unsigned long long> dropped_bytes_{ 0 };
+		std::atomic<unsigned long long> coalesced_messages_{ 0 };
+
+		std::mutex coalesce_mtx_;
+	};
+}
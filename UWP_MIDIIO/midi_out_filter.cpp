@@ -0,0 +1,136 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_out_filter.cpp:
+//   Duplicate message filter `midi_out_filter`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "midi_out_filter.h"
+#include "midi_parser.h"
+
+namespace uwp_midiio
+{
+	namespace
+	{
+		constexpr size_t PROGRAM_KEY{ 128 };
+		constexpr size_t PRESSURE_KEY{ 129 };
+		constexpr size_t PITCH_BEND_KEY{ 130 };
+
+		// Controllers that act rather than set a value
+		// (bank select, data entry, RPN/NRPN, channel mode)
+		// are never filtered.
+		constexpr bool is_value_controller(unsigned char cc)
+		{
+			return !(cc == 0 || cc == 6 || cc == 32 || cc == 38 ||
+				(cc >= 96 && cc <= 101) ||
+				cc >= 120);
+		}
+	}
+
+	bool midi_out_filter::pass(const unsigned char* data, size_t len,
+		midi_clock::time_point now, midi_clock::duration window)
+	{
+		if (!len || data[0] >= 0xf8)
+		{
+			// System reset may reset everything.
+			if (len && data[0] == 0xff)
+				clear();
+			return true;
+		}
+
+		if (!(data[0] & 0x80) || data[0] == 0xf0 ||
+			len != message_length(data[0]))
+		{
+			// SysEx (e.g. GM reset) or several messages
+			// may change any value.
+			clear();
+			return true;
+		}
+
+		const size_t channel{ data[0] & 0x0fu };
+		size_t key{ 0 };
+		uint16_t value{ 0 };
+		switch (data[0] & 0xf0)
+		{
+		case 0xb0:
+			if (data[1] == 0 || data[1] == 32)
+			{
+				// The next program change selects from the new bank.
+				clear_channel(channel, PROGRAM_KEY, PROGRAM_KEY);
+				return true;
+			}
+			if (data[1] == 121)
+			{
+				// Reset all controllers
+				clear_channel(channel, 0, PITCH_BEND_KEY);
+				return true;
+			}
+			if (!is_value_controller(data[1]))
+				return true;
+			key = data[1];
+			value = data[2];
+			break;
+		case 0xc0:
+			key = PROGRAM_KEY;
+			value = data[1];
+			break;
+		case 0xd0:
+			key = PRESSURE_KEY;
+			value = data[1];
+			break;
+		case 0xe0:
+			key = PITCH_BEND_KEY;
+			value = static_cast<uint16_t>(data[1] | (data[2] << 7));
+			break;
+		default:
+			return true;
+		}
+
+		const auto index{ channel * KEYS_PER_CHANNEL + key };
+		if (values_[index] == value &&
+			now - midi_clock::time_point(midi_clock::duration(
+			times_[index])) < window)
+			return false;
+
+		values_[index] = value;
+		times_[index] = now.time_since_epoch().count();
+		return true;
+	}
+
+	void midi_out_filter::clear_channel(size_t channel, size_t first,
+		size_t last)
+	{
+		const auto begin{ values_.begin() + channel * KEYS_PER_CHANNEL };
+		std::fill(begin + first, begin + last + 1, NO_VALUE);
+	}
+}
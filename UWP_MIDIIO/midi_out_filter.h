@@ -0,0 +1,77 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_out_filter.h:
+//   Duplicate message filter `midi_out_filter`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "pch.h"
+
+#include "midi_clock.h"
+
+namespace uwp_midiio
+{
+	// Remembers the last value sent for each controller, program,
+	// channel pressure and pitch bend of each channel
+	// and tells exact repeats of them.
+	// Notes, SysEx and other messages always pass.
+	// Not thread-safe (used by the thread that sends).
+	class midi_out_filter final
+	{
+		static constexpr size_t KEYS_PER_CHANNEL{ 128 + 3 };
+		static constexpr size_t KEYS{ 16 * KEYS_PER_CHANNEL };
+		static constexpr uint16_t NO_VALUE{ 0xffff };
+
+	public:
+		midi_out_filter()
+		{
+			clear();
+		}
+
+		// Returns false if `data` repeats the last value sent
+		// less than `window` ago. Otherwise records it as sent.
+		bool pass(const unsigned char* data, size_t len,
+			midi_clock::time_point now, midi_clock::duration window);
+		// Forgets all values
+		void clear()
+		{
+			values_.fill(NO_VALUE);
+		}
+
+	private:
+		void clear_channel(size_t channel, size_t first, size_t last);
+
+		std::array<uint16_t, KEYS> values_;
+		std::array<midi_clock::rep, KEYS> times_{};
+	};
+}
@@ -0,0 +1,65 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_out_scheduler.cpp:
+//   MIDI OUT scheduler class `midi_out_scheduler`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "midi_out_scheduler.h"
+
+namespace uwp_midiio
+{
+	midi_out_scheduler::midi_out_scheduler(size_t capacity) :
+		capacity_(capacity)
+	{
+		// Scheduling short messages does not allocate.
+		heap_.reserve(capacity);
+	}
+
+	bool midi_out_scheduler::push(const unsigned char* data, size_t len,
+		long long time)
+	{
+		if (full())
+			return false;
+
+		message m{ time, sequence_++, static_cast<uint32_t>(len), {}, {} };
+		if (len > SHORT_MESSAGE_SIZE)
+			m.long_bytes.assign(data, data + len);
+		else
+			std::memcpy(m.bytes, data, len);
+
+		heap_.push_back(std::move(m));
+		std::push_heap(heap_.begin(), heap_.end(), later{});
+		return true;
+	}
+}
@@ -0,0 +1,122 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_out_scheduler.h:
+//   MIDI OUT scheduler class `midi_out_scheduler`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "pch.h"
+
+namespace uwp_midiio
+{
+	// Messages waiting for their send time, earliest first.
+	// Messages with the same time keep the order in which they were pushed.
+	// Not thread-safe (used by the sender thread only).
+	class midi_out_scheduler final
+	{
+		static constexpr size_t SHORT_MESSAGE_SIZE{ 4 };
+
+		struct message
+		{
+			long long time;
+			unsigned long long sequence;
+			uint32_t length;
+			unsigned char bytes[SHORT_MESSAGE_SIZE];
+			// Used only for messages longer than SHORT_MESSAGE_SIZE
+			std::vector<unsigned char> long_bytes;
+
+			const unsigned char* data() const
+			{
+				return length > SHORT_MESSAGE_SIZE ?
+					long_bytes.data() : bytes;
+			}
+		};
+
+		struct later
+		{
+			bool operator()(const message& a, const message& b) const
+			{
+				return a.time > b.time ||
+					(a.time == b.time && a.sequence > b.sequence);
+			}
+		};
+
+	public:
+		explicit midi_out_scheduler(size_t capacity);
+
+		midi_out_scheduler(const midi_out_scheduler&) = delete;
+		midi_out_scheduler& operator=(const midi_out_scheduler&) = delete;
+		midi_out_scheduler(midi_out_scheduler&&) = delete;
+		midi_out_scheduler& operator=(midi_out_scheduler&&) = delete;
+
+		// Returns false if `capacity` messages are already scheduled.
+		bool push(const unsigned char* data, size_t len, long long time);
+
+		// Calls `f(data, len)` for the earliest message
+		// and removes it if `f` returns true.
+		template<class F>
+		bool pop(F&& f)
+		{
+			const auto& m{ heap_.front() };
+			if (!f(m.data(), static_cast<size_t>(m.length)))
+				return false;
+
+			std::pop_heap(heap_.begin(), heap_.end(), later{});
+			heap_.pop_back();
+			return true;
+		}
+
+		// Time of the earliest message
+		long long top_time() const
+		{
+			return heap_.front().time;
+		}
+		size_t size() const
+		{
+			return heap_.size();
+		}
+		bool empty() const
+		{
+			return heap_.empty();
+		}
+		bool full() const
+		{
+			return heap_.size() >= capacity_;
+		}
+
+	private:
+		const size_t capacity_;
+		std::vector<message> heap_;
+		unsigned long long sequence_{ 0 };
+	};
+}
@@ -0,0 +1,243 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_parser.h:
+//   Streaming MIDI byte parser `midi_parser`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "midi_scan.h"
+
+namespace uwp_midiio
+{
+	namespace detail
+	{
+		constexpr std::array<unsigned char, 256> make_message_length_table()
+		{
+			std::array<unsigned char, 256> table{};
+
+			// Data bytes, SysEx (variable), undefined and stray EOX
+			// are left 0.
+			for (size_t i{ 0x80 }; i < 0xf0; ++i)
+				table[i] = (i >= 0xc0 && i < 0xe0) ? 2 : 3;
+			table[0xf1] = 2;  // MTC quarter frame
+			table[0xf2] = 3;  // song position pointer
+			table[0xf3] = 2;  // song select
+			table[0xf6] = 1;  // tune request
+			for (size_t i{ 0xf8 }; i < 0x100; ++i)
+				table[i] = 1;  // realtime (0xf9 and 0xfd included)
+
+			return table;
+		}
+	}
+
+	constexpr auto MESSAGE_LENGTH_TABLE
+		{ detail::make_message_length_table() };
+
+	// Length of the message including the status byte,
+	// 0 for data bytes, SysEx and undefined status bytes.
+	constexpr size_t message_length(unsigned char status)
+	{
+		return MESSAGE_LENGTH_TABLE[status];
+	}
+
+	// Whether a piece given by midi_parser::parse is (a part of) a SysEx.
+	// Only the first piece starts with 0xf0; the others start with
+	// a data byte, or with EOX when a realtime message has split it
+	// from the rest.
+	constexpr bool is_sysex_piece(const unsigned char* data)
+	{
+		return data[0] == 0xf0 || data[0] == 0xf7 || !(data[0] & 0x80);
+	}
+
+	// Splits a MIDI byte stream into messages in one pass
+	// without allocating.
+	// The state (running status, an incomplete message, SysEx in progress)
+	// is kept between calls, so a stream can be given in any pieces.
+	class midi_parser
+	{
+	public:
+		// Calls `f(data, len)` for each message in order:
+		// short messages always with their status byte
+		// (running status is expanded), realtime messages as they appear
+		// (also inside other messages).
+		// SysEx is given in one piece if it is contiguous in `data`,
+		// otherwise in several pieces that are split at realtime messages
+		// and at the end of `data`; only the first piece starts with 0xf0.
+		// A status byte other than realtime and EOX ends a SysEx
+		// without EOX. Data bytes without status and undefined status
+		// bytes are ignored.
+		// Stops at the first message for which `f` returns false and
+		// returns the number of bytes of `data` before that message
+		// (the rest can be given again later). Otherwise returns `len`.
+		template<class F>
+		size_t parse(const unsigned char* data, size_t len, F&& f)
+		{
+			const auto end{ data + len };
+			auto p{ data };
+			// Where the incomplete short message started
+			// and how many of its bytes came before `data`
+			auto start{ data };
+			auto start_filled{ filled_ };
+
+			while (p < end)
+			{
+				if (sysex_)
+				{
+					// The first piece starts with 0xf0. Any other 0xf0
+					// ends the SysEx and starts a new one.
+					const auto status{ find_status(
+						sysex_first_ ? p + 1 : p, end) };
+					if (status == end)
+					{
+						if (!f(p, static_cast<size_t>(end - p)))
+							return static_cast<size_t>(p - data);
+						sysex_first_ = false;
+						return len;
+					}
+
+					if (*status == 0xf7)
+					{
+						if (!f(p, static_cast<size_t>(status + 1 - p)))
+							return static_cast<size_t>(p - data);
+						sysex_ = false;
+						sysex_first_ = false;
+						p = status + 1;
+						continue;
+					}
+
+					if (status != p)
+					{
+						if (!f(p, static_cast<size_t>(status - p)))
+							return static_cast<size_t>(p - data);
+						sysex_first_ = false;
+						p = status;
+					}
+					if (*status >= 0xf8)
+					{
+						if (!f(status, 1))
+							return static_cast<size_t>(p - data);
+						++p;
+					}
+					else
+						sysex_ = false;
+					continue;
+				}
+
+				const auto b{ *p };
+				if (b >= 0xf8)
+				{
+					if (!f(p, 1))
+						return static_cast<size_t>(p - data);
+					++p;
+					continue;
+				}
+
+				if (b & 0x80)
+				{
+					filled_ = 0;
+					if (b == 0xf0)
+					{
+						running_status_ = 0;
+						sysex_ = true;
+						sysex_first_ = true;
+						continue;
+					}
+
+					// System common messages cancel running status.
+					running_status_ = b < 0xf0 ? b : 0;
+					expected_ = message_length(b);
+					++p;
+					if (!expected_)
+						continue;
+					start = p - 1;
+					start_filled = 0;
+					message_[filled_++] = b;
+				}
+				else
+				{
+					++p;
+					if (!filled_)
+					{
+						if (!running_status_)
+							continue;
+						start = p - 1;
+						start_filled = 0;
+						message_[filled_++] = running_status_;
+						expected_ = message_length(running_status_);
+					}
+					message_[filled_++] = b;
+				}
+
+				if (filled_ == expected_)
+				{
+					if (!f(message_.data(), filled_))
+					{
+						// Giving the bytes from `start` again
+						// completes the same message.
+						filled_ = start_filled;
+						return static_cast<size_t>(start - data);
+					}
+					filled_ = 0;
+				}
+			}
+
+			return len;
+		}
+
+		void reset()
+		{
+			running_status_ = 0;
+			filled_ = 0;
+			expected_ = 0;
+			sysex_ = false;
+			sysex_first_ = false;
+		}
+
+		bool in_sysex() const
+		{
+			return sysex_;
+		}
+
+	private:
+		std::array<unsigned char, 3> message_{};
+		size_t filled_{ 0 };
+		size_t expected_{ 0 };
+		unsigned char running_status_{ 0 };
+		bool sysex_{ false };
+		// The 0xf0 of the SysEx has not been given yet.
+		bool sysex_first_{ false };
+	};
+}
@@ -42,6 +42,7 @@
 #include "midi_port.h"
 
 #include "debug_message.h"
+#include "device_watcher.h"
 #include "midi_port_in.h"
 #include "midi_port_out.h"
 #include "uwp_midiio.h"
@@ -74,9 +75,284 @@ namespace uwp_midiio
 		if (port())
 		{
 			port().Close();
-			port() = nullptr;
+			set_port(nullptr);
 		}
 
+		set_port(open_port(id));
+
+		DEBUG_MESSAGE_W(L"returns\n");
+		return;
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::open_async(std::wstring_view display_name,
+			std::function<void(open_state)> done)
+	{
+		DEBUG_MESSAGE_W(L"enter \"" << display_name << L"\"\n");
+
+		state_.store(open_state::connecting, std::memory_order_release);
+		try
+		{
+			open_thread_ = std::thread(
+				[this, name{ std::wstring(display_name) },
+				done{ std::move(done) }]
+			{
+				open_from_display_name(name);
+
+				const auto s{ port() ?
+					open_state::open : open_state::failed };
+				finish_open(s);
+				if (done && !open_cancelled_.load())
+					done(s);
+			});
+		}
+		catch (std::system_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception " << ex.what() << L"\n");
+			set_state(open_state::failed);
+		}
+
+		DEBUG_MESSAGE_W(L"returns\n");
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	open_state uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::wait_open(long timeout_ms)
+	{
+		std::unique_lock<std::mutex> lock(state_mtx_);
+
+		auto pred{ [this]
+		{
+			return closed_ || state() != open_state::connecting;
+		} };
+		if (timeout_ms < 0)
+			state_cv_.wait(lock, pred);
+		else
+			state_cv_.wait_for(lock,
+				std::chrono::milliseconds(timeout_ms), pred);
+		return closed_ ? open_state::closed : state();
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::set_state(open_state s)
+	{
+		{
+			std::lock_guard<std::mutex> lock(state_mtx_);
+			state_.store(s, std::memory_order_release);
+		}
+		state_cv_.notify_all();
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::drain_refs()
+	{
+		// The calls return soon since they have been woken up.
+		refs_released_.wait([this]
+		{
+			return refs_.load(std::memory_order_acquire) == 0;
+		});
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::close_wait_open()
+	{
+		{
+			std::lock_guard<std::mutex> lock(state_mtx_);
+			closed_ = true;
+		}
+		state_cv_.notify_all();
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::cancel_open()
+	{
+		stop_reconnect();
+
+		if (!open_thread_.joinable())
+			return;
+
+		DEBUG_MESSAGE_W(L"  waiting for the open thread\n");
+		open_cancelled_.store(true);
+		open_thread_.join();
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	bool uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::set_reconnect(bool enable)
+	{
+		DEBUG_MESSAGE_W(L"enter " << enable << L"\n");
+
+		if (!enable)
+		{
+			stop_reconnect();
+			return true;
+		}
+		if (watcher_token_)
+			return true;
+
+		watcher_token_ = device_watcher::subscribe(
+			[this](std::wstring_view id, bool present)
+		{
+			device_changed(id, present);
+		});
+
+		DEBUG_MESSAGE_W(L"returns " << (watcher_token_ != 0) << L"\n");
+		return watcher_token_ != 0;
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::device_changed(std::wstring_view id, bool present)
+	{
+		std::unique_lock<std::mutex> lock(reconnect_mtx_);
+
+		if (id != id_)
+			return;
+
+		present_ = present;
+		if (present)
+		{
+			reconnect_cv_.notify_all();
+			return;
+		}
+		// Ports still connecting are handled by open_async.
+		if (lost_ || state() != open_state::open)
+			return;
+
+		WARNING_MESSAGE_W(L"device lost \"" << id << L"\"\n");
+
+		lost_ = true;
+		lost_time_ = midi_clock::now();
+		set_state(open_state::connecting);
+		lost();
+
+		// The previous reconnection has finished
+		// since it clears lost_ at the end.
+		auto previous{ std::move(reconnect_thread_) };
+		try
+		{
+			reconnect_thread_ = std::thread([this]
+			{
+				reconnect();
+			});
+		}
+		catch (std::system_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception " << ex.what() << L"\n");
+		}
+		lock.unlock();
+
+		if (previous.joinable())
+			previous.join();
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::reconnect()
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		std::unique_lock<std::mutex> lock(reconnect_mtx_);
+
+		while (!reconnect_stop_)
+		{
+			// Retried at intervals too,
+			// in case the device comes back unnoticed.
+			if (!present_)
+			{
+				reconnect_cv_.wait_for(lock, MIDI_PORT_RECONNECT_INTERVAL,
+					[this]
+				{
+					return reconnect_stop_ || present_;
+				});
+				if (reconnect_stop_)
+					break;
+			}
+			present_ = false;
+
+			const auto id{ id_ };
+			lock.unlock();
+			open_from_id(id);
+			lock.lock();
+
+			if (port())
+			{
+				const auto elapsed{ midi_clock::now() - lost_time_ };
+				last_reconnect_time_.store(elapsed.count());
+				++reconnects_;
+
+				DEBUG_MESSAGE_W(L"reconnected in "
+					<< std::chrono::duration_cast<
+					std::chrono::milliseconds>(elapsed).count()
+					<< L" ms\n");
+
+				// Under the lock so that a disconnection
+				// is not overwritten by this.
+				lost_ = false;
+				finish_open(open_state::open);
+				return;
+			}
+		}
+
+		DEBUG_MESSAGE_W(L"returns, stopped\n");
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	void uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::stop_reconnect()
+	{
+		if (!watcher_token_)
+			return;
+
+		// device_changed does not start a thread any more.
+		device_watcher::unsubscribe(watcher_token_);
+		watcher_token_ = 0;
+
+		std::thread t;
+		{
+			std::lock_guard<std::mutex> lock(reconnect_mtx_);
+
+			reconnect_stop_ = true;
+			t = std::move(reconnect_thread_);
+		}
+		reconnect_cv_.notify_all();
+		if (t.joinable())
+		{
+			DEBUG_MESSAGE_W(L"  waiting for the reconnection thread\n");
+			t.join();
+		}
+
+		std::lock_guard<std::mutex> lock(reconnect_mtx_);
+
+		reconnect_stop_ = false;
+		if (lost_)
+		{
+			// Not to wait for the device that has gone
+			lost_ = false;
+			finish_open(open_state::failed);
+		}
+	}
+
+	template<class Derived, class MidiIO_T,
+		class MidiPort_T, class IMidiPort_T>
+	IMidiPort_T uwp_midiio_port<Derived, MidiIO_T, MidiPort_T, IMidiPort_T
+		>::open_port(std::wstring_view id)
+	{
 		DEBUG_MESSAGE_W(L"  trying FromIdAsync\n");
 		try
 		{
@@ -86,7 +362,7 @@ namespace uwp_midiio
 			if (async.wait_for(MIDI_PORT_OPEN_TIMEOUT) ==
 				AsyncStatus::Completed)
 			{
-				port() = async.GetResults();
+				return async.GetResults();
 			}
 		}
 		catch (winrt::hresult_error const& ex)
@@ -96,11 +372,8 @@ namespace uwp_midiio
 				<< L", "
 				<< static_cast<std::wstring_view>(ex.message())
 				<< L"\n");
-
-			return;
 		}
 
-		DEBUG_MESSAGE_W(L"returns\n");
-		return;
+		return nullptr;
 	}
 }
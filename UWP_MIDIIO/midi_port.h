@@ -38,10 +38,22 @@
 #include "pch.h"
 #include "config.h"
 
+#include "midi_clock.h"
+#include "notifier.h"
 #include "uwp_midiio.h"
 
 namespace uwp_midiio
 {
+	// State of a port opened by open_async or reconnecting
+	enum class open_state
+	{
+		connecting,
+		open,
+		failed,
+		// Only returned by wait_open when the port is being closed
+		closed,
+	};
+
 	template<class Derived, class MidiIO_T,
 		class MidiPort_T, class IMidiPort_T>
 	class uwp_midiio_port : public MidiIO_T
@@ -58,23 +70,47 @@ namespace uwp_midiio
 		uwp_midiio_port(uwp_midiio_port&&) = delete;
 		uwp_midiio_port& operator=(uwp_midiio_port&&) = delete;
 
-		MidiIO_T* get_ptr()
+		// References by port_ref
+		void add_ref()
 		{
-			return this;
+			refs_.fetch_add(1, std::memory_order_relaxed);
 		}
-		static Derived* get_class(MidiIO_T* ptr)
+		void release_ref()
 		{
-			return static_cast<Derived*>(ptr);
+			if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				refs_released_.notify();
 		}
+		// Waits until all the references have been released.
+		// Only for closing, after new references cannot be added
+		// and the calls using them have been woken up.
+		void drain_refs();
 
-		IMidiPort_T& port()
+		// Only for the thread that opens the port.
+		// The others use current_port since reconnection swaps it.
+		const IMidiPort_T& port() const
 		{
 			return port_;
 		}
+		IMidiPort_T current_port() const
+		{
+			std::lock_guard<std::mutex> lock(port_mtx_);
+
+			return port_;
+		}
 		void set_display_name(std::wstring_view display_name)
 		{
 			display_name_ = display_name;
-			m_pDeviceName = display_name_.data();
+			this->m_pDeviceName = display_name_.data();
+		}
+		// The handle given to the application (set once it is made).
+		// Callbacks pass it instead of `this`.
+		MidiIO_T* handle() const
+		{
+			return handle_;
+		}
+		void set_handle(MidiIO_T* handle)
+		{
+			handle_ = handle;
 		}
 
 		virtual std::wstring find_id_from_display_name(
@@ -82,13 +118,107 @@ namespace uwp_midiio
 
 		virtual void open_from_id(std::wstring_view id);
 
+		// Returns nullptr on failure or timeout
+		static IMidiPort_T open_port(std::wstring_view id);
+
 		void open_from_display_name(std::wstring_view display_name)
 		{
-			open_from_id(find_id_from_display_name(display_name));
+			auto id{ find_id_from_display_name(display_name) };
+			{
+				std::lock_guard<std::mutex> lock(reconnect_mtx_);
+
+				id_ = id;
+			}
+			open_from_id(id);
+		}
+
+		// Opens the port in a thread and returns at once.
+		// `done` is called from the thread when the port has been opened
+		// or has failed, unless the port is being destroyed.
+		void open_async(std::wstring_view display_name,
+			std::function<void(open_state)> done);
+		open_state state() const
+		{
+			return state_.load(std::memory_order_acquire);
 		}
+		// Waits while connecting. Negative timeout means infinite.
+		// Returns open_state::closed if the port is being closed.
+		open_state wait_open(long timeout_ms);
+
+		// When the device disconnects (e.g. BLE), the state goes back to
+		// connecting and the port is opened again by the same device id
+		// in a thread when the device comes back.
+		// Returns false on failure.
+		bool set_reconnect(bool enable);
+		unsigned long long reconnects() const
+		{
+			return reconnects_.load();
+		}
+		// Time from the disconnection to the last reconnection
+		midi_clock::duration last_reconnect_time() const
+		{
+			return midi_clock::duration{ last_reconnect_time_.load() };
+		}
+
+	protected:
+		void set_port(IMidiPort_T p)
+		{
+			std::lock_guard<std::mutex> lock(port_mtx_);
+
+			port_ = std::move(p);
+		}
+		// Called when the device has disconnected
+		virtual void lost()
+		{
+		}
+		// Called from the thread of open_async
+		virtual void finish_open(open_state s)
+		{
+			set_state(s);
+		}
+		void set_state(open_state s);
+		// Wakes up wait_open for closing
+		void close_wait_open();
+		// Must be called first by the destructor of the derived class
+		// so that the threads of open_async and the reconnection
+		// do not use it any more.
+		void cancel_open();
 
 	private:
+		void device_changed(std::wstring_view id, bool present);
+		void reconnect();
+		void stop_reconnect();
+
 		IMidiPort_T port_;
+		mutable std::mutex port_mtx_;
 		std::wstring display_name_;
+		MidiIO_T* handle_{ nullptr };
+		std::atomic<size_t> refs_{ 0 };
+		// Shared by all ports, since the last release_ref still
+		// notifies when the port may already have been destroyed
+		inline static notifier refs_released_;
+
+		// Ports opened synchronously are open when they are found
+		std::atomic<open_state> state_{ open_state::open };
+		std::mutex state_mtx_;
+		std::condition_variable state_cv_;
+		// Guarded by state_mtx_
+		bool closed_{ false };
+		std::thread open_thread_;
+		std::atomic<bool> open_cancelled_{ false };
+
+		size_t watcher_token_{ 0 };
+		std::mutex reconnect_mtx_;
+		std::condition_variable reconnect_cv_;
+		std::thread reconnect_thread_;
+		// Guarded by reconnect_mtx_
+		std::wstring id_;
+		bool lost_{ false };
+		bool present_{ false };
+		bool reconnect_stop_{ false };
+		midi_clock::time_point lost_time_{};
+
+		std::atomic<unsigned long long> reconnects_{ 0 };
+		std::atomic<midi_clock::rep> last_reconnect_time_{ 0 };
 	};
 }
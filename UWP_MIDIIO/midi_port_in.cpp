@@ -43,6 +43,7 @@
 
 #include "debug_message.h"
 #include "device_enum.h"
+#include "midi_ports.h"
 
 using namespace std::chrono_literals;
 
@@ -54,6 +55,8 @@ using namespace Windows::Security::Cryptography;
 
 namespace uwp_midiio
 {
+	notifier uwp_midiio_port_in::notifier_;
+
 	std::wstring uwp_midiio_port_in::find_id_from_display_name(
 		std::wstring_view display_name)
 	{
@@ -64,103 +67,422 @@ namespace uwp_midiio
 	{
 		DEBUG_MESSAGE_W(L"enter\n");
 
-		uwp_midiio_port::open_from_id(id);
+		if (connection_)
+		{
+			connection_->detach(this);
+			connection_.reset();
+			set_port(nullptr);
+		}
 
-		if (!port())
+		connection_ = midi_in_connection::acquire(id);
+		if (!connection_)
 		{
-			WARNING_MESSAGE_W(L"port is nullptr\n");
+			WARNING_MESSAGE_W(L"connection is nullptr\n");
 			return;
 		}
+		set_port(connection_->port());
+		connection_->attach(this);
+
+		DEBUG_MESSAGE_W(L"returns\n");
+	}
+
+	void uwp_midiio_port_in::receive(const unsigned char* data, size_t len,
+		long long timestamp)
+	{
+		if (message_queue_.push(data, len, timestamp))
+			notifier_.notify();
+	}
+
+	size_t uwp_midiio_port_in::pop_message(unsigned char* buff,
+		size_t capacity, long long* timestamp)
+	{
+		// TRACE_MESSAGE_W(L"enter\n");
+
+		if (has_callback())
+			return 0;
+
+		report_dropped();
+
+		size_t len{ 0 };
 
-		DEBUG_MESSAGE_W(L"  trying MessageReceived\n");
-		try
+		if (!consume(1,
+			[&](const unsigned char* data, size_t l, long long ts)
 		{
-			before_token_ = port().MessageReceived(
-				{ this, &uwp_midiio_port_in::midi_in_callback });
-			DEBUG_MESSAGE_W(L"  before_token is "
-				<< static_cast<bool>(before_token_)
-				<< L" (value = "
-				<< before_token_.value
-				<< L")\n");
+			TRACE_MESSAGE_W(L"received message exists\n");
+
+			if (capacity < l)
+			{
+				WARNING_MESSAGE_W(L"Destination buffer capacity ("
+					<< capacity
+					<< L") is smaller than received message length ("
+					<< l
+					<< L"). Truncated.");
+				l = capacity;
+			}
+			TRACE_MESSAGE_W(L"  trying std::memcpy\n");
+			std::memcpy(buff, data, l);
+			if (timestamp)
+				*timestamp = ts;
+			len = l;
+			return true;
+		}))
+		{
+			// TRACE_MESSAGE_W(L"returns 0, message queue is empty\n");
+			return 0;
 		}
-		catch (winrt::hresult_error const& ex)
+
+		TRACE_MESSAGE_W(L"returns " << len << "\n");
+		return len;
+	}
+	size_t uwp_midiio_port_in::pop_messages(unsigned char* buff,
+		size_t capacity, long* lengths, long long* timestamps,
+		size_t max_count)
+	{
+		if (has_callback())
+			return 0;
+
+		return receive_messages(buff, capacity, lengths, timestamps,
+			max_count);
+	}
+	size_t uwp_midiio_port_in::receive_messages(unsigned char* buff,
+		size_t capacity, long* lengths, long long* timestamps,
+		size_t max_count)
+	{
+		// TRACE_MESSAGE_W(L"enter\n");
+
+		if (capacity == 0)
+			return 0;
+
+		report_dropped();
+
+		size_t used{ 0 };
+		size_t count{ 0 };
+		consume(max_count,
+			[&](const unsigned char* data, size_t len, long long timestamp)
 		{
-			WARNING_MESSAGE_W(L"exception 0x"
-				<< std::hex << ex.code()
-				<< L", "
-				<< static_cast<std::wstring_view>(ex.message())
-				<< L"\n");
+			if (len > capacity - used)
+			{
+				if (count != 0)
+					return false;
 
-			return;
+				WARNING_MESSAGE_W(L"Destination buffer capacity ("
+					<< capacity
+					<< L") is smaller than received message length ("
+					<< len
+					<< L"). Truncated.");
+				len = capacity;
+			}
+			std::memcpy(buff + used, data, len);
+			lengths[count] = static_cast<long>(len);
+			if (timestamps)
+				timestamps[count] = timestamp;
+			used += len;
+			++count;
+			return true;
+		});
+
+		// Not for every poll that finds nothing
+		if (count)
+		{
+			TRACE_MESSAGE_W(L"returns " << count << L", "
+				<< used << L" byte(s)\n");
 		}
+		return count;
+	}
+	size_t uwp_midiio_port_in::pop_partial(unsigned char* buff,
+		size_t capacity, size_t* remaining, long long* timestamp,
+		bool* dropped)
+	{
+		// TRACE_MESSAGE_W(L"enter\n");
 
-		DEBUG_MESSAGE_W(L"returns\n");
+		if (remaining)
+			*remaining = 0;
+		if (dropped)
+			*dropped = false;
+		if (has_callback())
+			return 0;
+
+		report_dropped();
+
+		size_t len{ 0 };
+		size_t rest{ 0 };
+		auto read{ [&](const unsigned char* data, size_t l, long long ts)
+		{
+			len = std::min(l - partial_offset_, capacity);
+			std::memcpy(buff, data + partial_offset_, len);
+			partial_offset_ += len;
+			rest = l - partial_offset_;
+			if (timestamp)
+				*timestamp = ts;
+		} };
+
+		if (partial_length_)
+		{
+			read(partial_buffer_, partial_length_, partial_timestamp_);
+			if (rest == 0)
+				partial_offset_ = partial_length_ = 0;
+		}
+		else
+		{
+			message_queue_.consume(1,
+				[&](const unsigned char* data, size_t l, long long ts)
+			{
+				// The message read last time has been dropped.
+				if (partial_offset_ &&
+					partial_sequence_ != message_queue_.front_sequence())
+				{
+					WARNING_MESSAGE_W(L"partially read message dropped\n");
+					partial_offset_ = 0;
+					if (dropped)
+						*dropped = true;
+					return false;
+				}
+
+				read(data, l, ts);
+				if (rest == 0)
+				{
+					partial_offset_ = 0;
+					return true;
+				}
+				if (l <= PARTIAL_BUFFER_SIZE)
+				{
+					std::memcpy(partial_buffer_, data, l);
+					partial_length_ = l;
+					partial_timestamp_ = ts;
+					return true;
+				}
+				partial_sequence_ = message_queue_.front_sequence();
+				return false;
+			});
+		}
+
+		if (remaining)
+			*remaining = rest;
+
+		if (len)
+		{
+			TRACE_MESSAGE_W(L"returns " << len << L", remaining "
+				<< rest << L"\n");
+		}
+		return len;
+	}
+
+	size_t uwp_midiio_port_in::peek_length()
+	{
+		if (has_callback())
+			return 0;
+
+		if (partial_length_)
+			return partial_length_ - partial_offset_;
+
+		const auto len{ message_queue_.front_length() };
+		if (len && partial_sequence_ == message_queue_.front_sequence())
+			return len - partial_offset_;
+		return len;
+	}
+
+	bool uwp_midiio_port_in::has_message()
+	{
+		return partial_length_ || !message_queue_.empty();
 	}
 
-	void uwp_midiio_port_in::midi_in_callback(const MidiInPort&,
-		const MidiMessageReceivedEventArgs& e)
+	template<class F>
+	size_t uwp_midiio_port_in::consume(size_t max_count, F&& f)
+	{
+		// The rest of a partially read message comes first.
+		size_t count{ 0 };
+		if (partial_length_ && max_count)
+		{
+			if (!f(partial_buffer_ + partial_offset_,
+				partial_length_ - partial_offset_, partial_timestamp_))
+				return 0;
+			partial_offset_ = partial_length_ = 0;
+			++count;
+			--max_count;
+		}
+
+		return count + message_queue_.consume(max_count,
+			[&](const unsigned char* data, size_t len, long long timestamp)
+		{
+			auto offset{ partial_offset_ };
+			if (partial_sequence_ != message_queue_.front_sequence())
+				offset = 0;
+
+			if (!f(data + offset, len - offset, timestamp))
+				return false;
+			partial_offset_ = 0;
+			return true;
+		});
+	}
+
+	bool uwp_midiio_port_in::set_callback(MIDIIn_Callback callback,
+		void* user)
 	{
 		DEBUG_MESSAGE_W(L"enter\n");
 
+		if (delivery_thread_.get_id() == std::this_thread::get_id())
 		{
-			std::lock_guard<std::mutex> lock(mtx_);
+			WARNING_MESSAGE_W(L"called from the callback\n");
+			return false;
+		}
 
-			message_queue_.push_back(e.Message());
+		stop_delivery();
 
-			while (message_queue_.size() > MAX_MIDI_IN_QUEUE_SIZE)
+		if (callback)
+		{
+			DEBUG_MESSAGE_W(L"  trying std::thread\n");
+			try
+			{
+				delivery_stop_ = std::make_shared<std::atomic<bool>>(false);
+				delivery_thread_ = std::thread(&uwp_midiio_port_in::deliver,
+					this, callback, user, delivery_stop_);
+			}
+			catch (std::system_error const& ex)
 			{
-				WARNING_MESSAGE_W(L"queue overflow\n");
-				message_queue_.pop_front();
+				WARNING_MESSAGE_W(L"exception " << ex.what() << L"\n");
+				return false;
 			}
 		}
 
-		DEBUG_MESSAGE_W(L"returns\n");
+		DEBUG_MESSAGE_W(L"returns true\n");
+		return true;
 	}
 
-	size_t uwp_midiio_port_in::pop_message(unsigned char* buff,
-		size_t capacity)
+	void uwp_midiio_port_in::deliver(MIDIIn_Callback callback, void* user,
+		std::shared_ptr<std::atomic<bool>> stop)
 	{
-		// TRACE_MESSAGE_W(L"enter\n");
+		DEBUG_MESSAGE_W(L"enter\n");
 
-		IMidiMessage message;
+		// Messages longer than the arena are dropped by the queue,
+		// so any message fits in a buffer of the same size.
+		std::vector<unsigned char> buff(MIDI_IN_SYSEX_ARENA_SIZE);
+		std::vector<long> lengths(MIDI_IN_CALLBACK_BATCH_SIZE);
+		std::vector<long long> timestamps(MIDI_IN_CALLBACK_BATCH_SIZE);
 
+		for (;;)
 		{
-			std::lock_guard<std::mutex> lock(mtx_);
-
-			if (message_queue_.empty())
+			wait(-1, [this, &stop]
 			{
-				// TRACE_MESSAGE_W(L"returns 0, message queue is empty\n");
-				return 0;
-			}
+				return stop->load(std::memory_order_relaxed) ||
+					has_message();
+			});
+			if (stop->load(std::memory_order_relaxed))
+				break;
 
-			TRACE_MESSAGE_W(L"received message exists\n");
+			const auto count{ receive_messages(buff.data(), buff.size(),
+				lengths.data(), timestamps.data(), lengths.size()) };
+			if (count)
+				callback(handle(), buff.data(), lengths.data(),
+					timestamps.data(), static_cast<long>(count), user);
 
-			message = message_queue_.front();
-			message_queue_.pop_front();
+			// The callback may have closed the port,
+			// which must not be touched any more then.
+			if (stop->load(std::memory_order_relaxed))
+				break;
 		}
 
-		if (!message)
+		DEBUG_MESSAGE_W(L"returns\n");
+	}
+
+	void uwp_midiio_port_in::stop_delivery()
+	{
+		if (!delivery_thread_.joinable())
+			return;
+
+		DEBUG_MESSAGE_W(L"  stopping delivery thread\n");
+		delivery_stop_->store(true);
+
+		// Closing the port from its own callback:
+		// the thread returns as soon as the callback does.
+		if (delivery_thread_.get_id() == std::this_thread::get_id())
 		{
-			WARNING_MESSAGE_W(L"message is nullptr\n");
-			return 0;
+			DEBUG_MESSAGE_W(L"  detaching delivery thread\n");
+			delivery_thread_.detach();
+			return;
 		}
-		TRACE_MESSAGE_W(L"  trying RawData\n");
-		const auto raw_data{ message.RawData() };
-		TRACE_MESSAGE_W(L"  trying Length\n");
-		size_t len{ raw_data.Length() };
-		if (capacity < len)
-		{
-			WARNING_MESSAGE_W(L"Destination buffer capacity ("
-				<< capacity
-				<< L") is smaller than received message length ("
-				<< len
-				<< L"). Truncated.");
-			len = capacity;
+
+		notifier_.notify();
+		delivery_thread_.join();
+	}
+
+	void uwp_midiio_port_in::report_dropped()
+	{
+		// Overflow is reported in aggregate on the consumer side
+		// so that the callback does not get slower under overload.
+		const auto dropped{ message_queue_.dropped_messages() };
+		if (dropped == reported_dropped_)
+			return;
+
+		const auto now{ midi_clock::now() };
+		if (now - last_dropped_report_ < MIDI_IN_DROP_REPORT_INTERVAL)
+			return;
+
+		WARNING_MESSAGE_W(L"queue overflow, "
+			<< dropped - reported_dropped_
+			<< L" message(s) dropped (total "
+			<< dropped
+			<< L" message(s), "
+			<< message_queue_.dropped_bytes()
+			<< L" byte(s))\n");
+
+		reported_dropped_ = dropped;
+		last_dropped_report_ = now;
+	}
+
+	bool uwp_midiio_port_in::wait_message(long timeout_ms)
+	{
+		TRACE_MESSAGE_W(L"enter " << timeout_ms << L"\n");
+
+		if (has_callback())
+		{
+			WARNING_MESSAGE_W(L"callback is set\n");
+			return false;
 		}
-		TRACE_MESSAGE_W(L"  trying std::memcpy\n");
-		std::memcpy(buff, raw_data.data(), len);
 
-		TRACE_MESSAGE_W(L"returns " << len << "\n");
-		return len;
+		auto retval{ wait(timeout_ms, [this]
+		{
+			return closing_.load() || has_message();
+		}) && !closing_.load() };
+
+		TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	long uwp_midiio_port_in::wait_any(MIDIIn* const* ptrs, size_t count,
+		long timeout_ms)
+	{
+		TRACE_MESSAGE_W(L"enter " << count << L", " << timeout_ms << L"\n");
+
+		long index{ -1 };
+		wait(timeout_ms, [&]
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto port_ptr{ uwp_midiio_ports::find_in(ptrs[i]) };
+				if (port_ptr && !port_ptr->has_callback() &&
+					port_ptr->has_message())
+				{
+					index = static_cast<long>(i);
+					return true;
+				}
+			}
+			return false;
+		});
+
+		TRACE_MESSAGE_W(L"returns " << index << L"\n");
+		return index;
+	}
+
+	template<class Pred>
+	bool uwp_midiio_port_in::wait(long timeout_ms, Pred pred)
+	{
+		if (timeout_ms < 0)
+		{
+			notifier_.wait(pred);
+			return true;
+		}
+
+		return notifier_.wait_until(std::chrono::steady_clock::now() +
+			std::chrono::milliseconds(timeout_ms), pred);
 	}
 }
@@ -41,7 +41,11 @@
 #include "pch.h"
 #include "config.h"
 
+#include "midi_clock.h"
+#include "midi_in_connection.h"
+#include "midi_message_queue.h"
 #include "midi_port.h"
+#include "notifier.h"
 #include "uwp_midiio.h"
 
 namespace uwp_midiio
@@ -52,32 +56,133 @@ namespace uwp_midiio
 		winrt::Windows::Devices::Midi::MidiInPort>
 	{
 	public:
-		uwp_midiio_port_in() :
-			message_queue_(
-				std::deque<winrt::Windows::Devices::Midi::IMidiMessage>
-				{DEFAULT_MIDI_IN_QUEUE_SIZE})
+		explicit uwp_midiio_port_in(
+			midi_message_queue::overflow_policy policy =
+			midi_message_queue::overflow_policy::drop_oldest,
+			size_t queue_size = MAX_MIDI_IN_QUEUE_SIZE) :
+			message_queue_(queue_size, MIDI_IN_SYSEX_ARENA_SIZE, policy)
 		{
-			message_queue_.clear();
 		}
 		~uwp_midiio_port_in() override
 		{
-			if (before_token_)
-				port().MessageReceived(before_token_);
+			cancel_open();
+			if (connection_)
+				connection_->detach(this);
+			stop_delivery();
 		}
 
 		std::wstring find_id_from_display_name(
 			std::wstring_view display_name) override;
 		void open_from_id(std::wstring_view id) override;
 
-		void midi_in_callback(
-			const winrt::Windows::Devices::Midi::MidiInPort&,
-			const winrt::Windows::Devices::Midi::MidiMessageReceivedEventArgs&
-			e);
-		size_t pop_message(unsigned char* buff, size_t capacity);
+		// Called by the connection for each received message
+		void receive(const unsigned char* data, size_t len,
+			long long timestamp);
+		size_t pop_message(unsigned char* buff, size_t capacity,
+			long long* timestamp = nullptr);
+		size_t pop_messages(unsigned char* buff, size_t capacity,
+			long* lengths, long long* timestamps, size_t max_count);
+		// Reads the next message from where the previous call stopped.
+		// The message is removed once all of it has been read.
+		// If overflow has dropped the message being read, sets `*dropped`
+		// and returns 0 without reading; the next call starts
+		// the next message.
+		size_t pop_partial(unsigned char* buff, size_t capacity,
+			size_t* remaining, long long* timestamp = nullptr,
+			bool* dropped = nullptr);
+		// Returns the unread length of the next message.
+		size_t peek_length();
+
+		unsigned long long dropped_messages() const
+		{
+			return message_queue_.dropped_messages();
+		}
+		unsigned long long dropped_bytes() const
+		{
+			return message_queue_.dropped_bytes();
+		}
+		unsigned long long coalesced_messages() const
+		{
+			return message_queue_.coalesced_messages();
+		}
+		void set_coalescing(size_t threshold)
+		{
+			message_queue_.set_coalesce_threshold(threshold);
+		}
+
+		// Delivers messages to `callback` on a dedicated thread
+		// instead of queuing them for the receive functions.
+		// nullptr goes back to polling.
+		bool set_callback(MIDIIn_Callback callback, void* user);
+		bool has_callback() const
+		{
+			return delivery_thread_.joinable();
+		}
+
+		// Negative timeout means infinite.
+		bool wait_message(long timeout_ms);
+		static long wait_any(MIDIIn* const* ptrs, size_t count,
+			long timeout_ms);
+
+		// Wakes up wait_message and wait_open for closing
+		void begin_close()
+		{
+			closing_.store(true);
+			notifier_.notify();
+			close_wait_open();
+		}
+
+	protected:
+		void lost() override
+		{
+			// Reconnecting opens the device again
+			// instead of sharing the dead connection.
+			if (connection_)
+				midi_in_connection::forget(connection_.get());
+		}
 
 	private:
-		std::deque<winrt::Windows::Devices::Midi::IMidiMessage> message_queue_;
-		winrt::event_token before_token_;
-		std::mutex mtx_;
+		template<class Pred>
+		static bool wait(long timeout_ms, Pred pred);
+		template<class F>
+		size_t consume(size_t max_count, F&& f);
+		bool has_message();
+		size_t receive_messages(unsigned char* buff, size_t capacity,
+			long* lengths, long long* timestamps, size_t max_count);
+		void deliver(MIDIIn_Callback callback, void* user,
+			std::shared_ptr<std::atomic<bool>> stop);
+		void stop_delivery();
+
+		void report_dropped();
+
+		// Shared by all ports so that one thread can wait on several ports
+		static notifier notifier_;
+
+		// Producer: receive (WinRT thread of the connection)
+		// Consumer: pop_message (host thread)
+		midi_message_queue message_queue_;
+		std::shared_ptr<midi_in_connection> connection_;
+
+		// Used by the consumer only
+		// A partially read message stays at the head of the queue.
+		// A short one is moved here instead,
+		// since coalescing could still modify it in the queue.
+		static constexpr size_t PARTIAL_BUFFER_SIZE{ 4 };
+		size_t partial_offset_{ 0 };
+		size_t partial_sequence_{ 0 };
+		size_t partial_length_{ 0 };
+		long long partial_timestamp_{ 0 };
+		unsigned char partial_buffer_[PARTIAL_BUFFER_SIZE]{};
+
+		unsigned long long reported_dropped_{ 0 };
+		midi_clock::time_point last_dropped_report_{};
+
+		// The consumer while a callback is set
+		// The stop flag is shared with the thread so that it outlives
+		// the port when the callback closes its own port.
+		std::thread delivery_thread_;
+		std::shared_ptr<std::atomic<bool>> delivery_stop_;
+
+		std::atomic<bool> closing_{ false };
 	};
 }
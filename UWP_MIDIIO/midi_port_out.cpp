@@ -39,19 +39,47 @@
 #include "pch.h"
 #include "config.h"
 
+#include <timeapi.h>
+
 #include "midi_port_out.h"
 
 #include "debug_message.h"
 #include "device_enum.h"
+#include "spsc_ring.h"
 
 using namespace winrt;
 using namespace Windows::Foundation;
 using namespace Windows::Devices::Midi;
 using namespace Windows::Storage::Streams;
-using namespace Windows::Security::Cryptography;
 
 namespace uwp_midiio
 {
+	uwp_midiio_port_out::uwp_midiio_port_out()
+	{
+		try
+		{
+			buffers_.reserve(MIDI_OUT_BUFFER_POOL_SIZE);
+			for (size_t i = 0; i < MIDI_OUT_BUFFER_POOL_SIZE; ++i)
+				buffers_.emplace_back(
+					static_cast<uint32_t>(MIDI_OUT_BUFFER_SIZE));
+		}
+		catch (winrt::hresult_error const& ex)
+		{
+			// Buffers are allocated when they are needed instead.
+			WARNING_MESSAGE_W(L"exception 0x"
+				<< std::hex << ex.code()
+				<< L", "
+				<< static_cast<std::wstring_view>(ex.message())
+				<< L"\n");
+		}
+	}
+
+	uwp_midiio_port_out::~uwp_midiio_port_out()
+	{
+		cancel_open();
+		stop_sender();
+	}
+
 	std::wstring uwp_midiio_port_out::find_id_from_display_name(
 		std::wstring_view display_name)
 	{
@@ -63,20 +91,46 @@ namespace uwp_midiio
 	{
 		TRACE_MESSAGE_W(L"enter\n");
 
-		if (!port())
+		Buffer b{ nullptr };
+		try
+		{
+			b = take_buffer(len);
+		}
+		catch (hresult_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception 0x"
+				<< std::hex << ex.code()
+				<< L", "
+				<< static_cast<std::wstring_view>(ex.message())
+				<< L"\n");
+
+			return false;
+		}
+
+		b.Length(static_cast<uint32_t>(len));
+		std::memcpy(b.data(), buff, len);
+		const auto retval{ write(b) };
+		return_buffer(std::move(b));
+
+		TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	bool uwp_midiio_port_out::write(Buffer const& b)
+	{
+		// Reconnection can swap it meanwhile.
+		const auto p{ current_port() };
+		if (!p)
 		{
 			WARNING_MESSAGE_W(L"port is nullptr\n");
 
 			return false;
 		}
 
-		TRACE_MESSAGE_W(L"  trying CreateFromByteArray\n");
 		try
 		{
-			auto b{ CryptographicBuffer::CreateFromByteArray
-				(array_view(buff, buff + len)) };
 			TRACE_MESSAGE_W(L"  trying SendBuffer\n");
-			port().SendBuffer(b);
+			p.SendBuffer(b);
 		}
 		catch (hresult_error const& ex)
 		{
@@ -89,7 +143,751 @@ namespace uwp_midiio
 			return false;
 		}
 
-		TRACE_MESSAGE_W(L"returns true\n");
 		return true;
 	}
+
+	template<class Send>
+	bool uwp_midiio_port_out::send_filtered(const unsigned char* buff,
+		size_t len, Send&& send)
+	{
+		if (filter_window_.load() == 0)
+			return send();
+
+		// Synchronous puts may come from several threads.
+		// Sending under the lock keeps another thread from dropping
+		// a repeat of a value that is not sent yet.
+		std::lock_guard<std::mutex> lock(filter_mtx_);
+		if (!filter(buff, len))
+		{
+			TRACE_MESSAGE_W(L"returns true, duplicate\n");
+			return true;
+		}
+		if (!send())
+		{
+			unfilter();
+			return false;
+		}
+		return true;
+	}
+
+	size_t uwp_midiio_port_out::send_to_ports(
+		uwp_midiio_port_out* const* ports, size_t count,
+		const unsigned char* buff, size_t len, long* results)
+	{
+		size_t sent{ 0 };
+		uwp_midiio_port_out* owner{ nullptr };
+		const auto report{ [&sent, results, len](size_t i, long result)
+		{
+			if (result == static_cast<long>(len))
+				++sent;
+			if (results)
+				results[i] = result;
+		} };
+
+		// The sender threads of the asynchronous ports send
+		// while the synchronous ports are being sent to.
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto p{ ports[i] };
+			if (!p)
+			{
+				report(i, 0);
+				continue;
+			}
+
+			if (p->is_async())
+			{
+				long held;
+				if (p->hold(buff, len, held))
+					report(i, held);
+				else
+				{
+					// The queue cannot give back the messages queued
+					// before it became full, so the caller is told
+					// where to put the rest from.
+					const auto queued{ static_cast<long>(
+						p->enqueue(buff, len)) };
+					report(i, queued ? queued : MIDIIO_ERROR_QUEUE_FULL);
+				}
+			}
+			else if (!owner)
+				owner = p;
+		}
+		if (!owner)
+			return sent;
+
+		Buffer b{ nullptr };
+		try
+		{
+			b = owner->take_buffer(len);
+		}
+		catch (hresult_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception 0x"
+				<< std::hex << ex.code()
+				<< L", "
+				<< static_cast<std::wstring_view>(ex.message())
+				<< L"\n");
+
+			for (size_t i = 0; i < count; ++i)
+				if (ports[i] && !ports[i]->is_async())
+					report(i, 0);
+			return sent;
+		}
+		b.Length(static_cast<uint32_t>(len));
+		std::memcpy(b.data(), buff, len);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto p{ ports[i] };
+			if (!p || p->is_async())
+				continue;
+
+			long held;
+			if (p->hold(buff, len, held))
+				report(i, held);
+			else if (p->send_filtered(buff, len, [p, &b]
+				{
+					return p->write(b);
+				}))
+				report(i, static_cast<long>(len));
+			else
+				report(i, 0);
+		}
+
+		owner->return_buffer(std::move(b));
+		return sent;
+	}
+
+	bool uwp_midiio_port_out::hold(const unsigned char* buff, size_t len,
+		long& result)
+	{
+		if (state() != open_state::connecting)
+			return false;
+
+		if (!buffer_while_connecting_.load())
+		{
+			TRACE_MESSAGE_W(L"returns true, rejected\n");
+			++lost_messages_;
+			result = MIDIIO_ERROR_NOT_CONNECTED;
+			return true;
+		}
+		// The sender thread waits for the connection.
+		if (is_async())
+			return false;
+
+		std::lock_guard<std::mutex> lock(connect_mtx_);
+
+		if (state() != open_state::connecting)
+			return false;
+
+		if (connect_buffer_.size() + len > MIDI_OUT_CONNECT_BUFFER_SIZE)
+		{
+			TRACE_MESSAGE_W(L"returns true, buffer is full\n");
+			++lost_messages_;
+			result = MIDIIO_ERROR_QUEUE_FULL;
+			return true;
+		}
+		try
+		{
+			connect_buffer_.insert(connect_buffer_.end(), buff, buff + len);
+		}
+		catch (std::bad_alloc&)
+		{
+			WARNING_MESSAGE_W(L"bad_alloc\n");
+			++lost_messages_;
+			result = MIDIIO_ERROR_QUEUE_FULL;
+			return true;
+		}
+
+		TRACE_MESSAGE_W(L"returns true, buffered\n");
+		result = static_cast<long>(len);
+		return true;
+	}
+
+	void uwp_midiio_port_out::finish_open(open_state s)
+	{
+		{
+			std::lock_guard<std::mutex> lock(connect_mtx_);
+
+			// Sent before the messages put after the connection
+			if (s == open_state::open && !connect_buffer_.empty())
+				send_buffer(connect_buffer_.data(), connect_buffer_.size());
+			connect_buffer_.clear();
+			connect_buffer_.shrink_to_fit();
+
+			set_state(s);
+		}
+
+		// The sender thread waits for the connection.
+		notifier_.notify();
+	}
+
+	bool uwp_midiio_port_out::send_message(const unsigned char* buff,
+		size_t len)
+	{
+		return send_filtered(buff, len, [this, buff, len]
+		{
+			return send_buffer(buff, len);
+		});
+	}
+
+	bool uwp_midiio_port_out::filter(const unsigned char* data, size_t len)
+	{
+		const midi_clock::duration window{ filter_window_.load() };
+		if (window == midi_clock::duration::zero())
+			return true;
+
+		if (filter_clear_.exchange(false))
+			filter_.clear();
+		if (filter_.pass(data, len, midi_clock::now(), window))
+			return true;
+
+		saved_bytes_.fetch_add(len);
+		return false;
+	}
+
+	void uwp_midiio_port_out::unfilter()
+	{
+		// The value recorded by the filter has not been sent.
+		// A disabled filter is cleared when enabled again.
+		if (filter_window_.load() != 0)
+			filter_.clear();
+	}
+
+	bool uwp_midiio_port_out::set_async(size_t queue_size)
+	{
+		DEBUG_MESSAGE_W(L"enter " << queue_size << L"\n");
+
+		// Queued messages are sent before switching.
+		stop_sender();
+		release_queues();
+
+		if (queue_size == 0)
+		{
+			DEBUG_MESSAGE_W(L"returns true, synchronous\n");
+			return true;
+		}
+
+		try
+		{
+			send_queue_ = std::make_unique<midi_message_queue>(queue_size,
+				MIDI_OUT_SYSEX_ARENA_SIZE,
+				midi_message_queue::overflow_policy::drop_newest);
+			scheduler_ = std::make_unique<midi_out_scheduler>(queue_size);
+			lanes_[static_cast<size_t>(lane::realtime)] =
+				std::make_unique<midi_message_queue>(
+				MIDI_OUT_REALTIME_LANE_SIZE, 1,
+				midi_message_queue::overflow_policy::drop_newest);
+			lanes_[static_cast<size_t>(lane::voice)] =
+				std::make_unique<midi_message_queue>(queue_size, 1,
+				midi_message_queue::overflow_policy::drop_newest);
+			lanes_[static_cast<size_t>(lane::sysex)] =
+				std::make_unique<midi_message_queue>(queue_size,
+				MIDI_OUT_SYSEX_ARENA_SIZE,
+				midi_message_queue::overflow_policy::drop_newest);
+			packed_.reserve(MIDI_OUT_PACKED_WRITE_SIZE);
+			parser_.reset();
+			sender_thread_ = std::thread(
+				&uwp_midiio_port_out::send_queued, this);
+		}
+		catch (std::bad_alloc&)
+		{
+			WARNING_MESSAGE_W(L"bad_alloc\n");
+			release_queues();
+			return false;
+		}
+		catch (std::system_error const& ex)
+		{
+			WARNING_MESSAGE_W(L"exception " << ex.what() << L"\n");
+			release_queues();
+			return false;
+		}
+
+		DEBUG_MESSAGE_W(L"returns true, asynchronous\n");
+		return true;
+	}
+
+	size_t uwp_midiio_port_out::enqueue(const unsigned char* buff,
+		size_t len, long long timestamp)
+	{
+		// Queued one by one so that the sender can pack, prioritize
+		// and chunk each message.
+		// The parser splits SysEx at the end of the given bytes,
+		// so giving them in slices keeps every piece within the arena.
+		size_t queued{ 0 };
+		while (queued < len)
+		{
+			const auto n{ std::min(len - queued, MIDI_OUT_SYSEX_PIECE_SIZE) };
+			const auto parsed{ parser_.parse(buff + queued, n,
+				[this, timestamp](const unsigned char* data, size_t l)
+				{
+					return send_queue_->push(data, l, timestamp);
+				}) };
+			queued += parsed;
+			if (parsed < n)
+				break;
+		}
+
+		if (queued)
+			notifier_.notify();
+		if (queued < len)
+		{
+			TRACE_MESSAGE_W(L"queue is full, " << queued << L" / "
+				<< len << L" bytes queued\n");
+		}
+		return queued;
+	}
+
+	size_t uwp_midiio_port_out::queue_depth() const
+	{
+		if (!send_queue_)
+			return 0;
+
+		// A message is added to the next stage before it is removed
+		// from the previous one, so reading the stages in this order
+		// never misses a message in transit.
+		size_t depth{ send_queue_->size() };
+		depth += scheduled_messages_.load();
+		for (const auto& q : lanes_)
+			depth += q->size();
+		depth += packed_messages_.load();
+		return depth;
+	}
+
+	bool uwp_midiio_port_out::flush(long timeout_ms)
+	{
+		DEBUG_MESSAGE_W(L"enter " << timeout_ms << L"\n");
+
+		if (!send_queue_)
+			return true;
+
+		auto pred{ [this]
+		{
+			return closing_.load() || queue_depth() == 0;
+		} };
+		if (timeout_ms < 0)
+		{
+			notifier_.wait(pred);
+			return !closing_.load();
+		}
+		auto retval{ notifier_.wait_until(std::chrono::steady_clock::now() +
+			std::chrono::milliseconds(timeout_ms), pred) &&
+			!closing_.load() };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	void uwp_midiio_port_out::send_queued()
+	{
+		DEBUG_MESSAGE_W(L"enter\n");
+
+		auto pred{ [this]
+		{
+			return sender_stop_.load(std::memory_order_relaxed) ||
+				(state() != open_state::connecting &&
+				!send_queue_->empty() && !scheduler_->full() &&
+				!lane_blocked_);
+		} };
+		auto connected{ [this]
+		{
+			return sender_stop_.load(std::memory_order_relaxed) ||
+				state() != open_state::connecting;
+		} };
+
+		tokens_time_ = midi_clock::now();
+
+		while (true)
+		{
+			// Nothing is sent while connecting, so the deadlines of
+			// scheduled and rate-limited messages (which may have
+			// passed) are not waited for. finish_open wakes it up.
+			notifier_.wait(connected);
+
+			const auto deadline{ next_deadline() };
+			if (deadline == midi_clock::time_point::max())
+				notifier_.wait(pred);
+			else
+				notifier_.wait_until(deadline, pred);
+
+			// Queued messages wait until the port has been opened
+			// (or reconnected). stop_sender waits for it for a while.
+			if (state() == open_state::connecting &&
+				!sender_stop_.load(std::memory_order_relaxed))
+				continue;
+
+			// Messages are removed from the queue after they have been
+			// sent, packed, scheduled or moved to a lane, so an empty
+			// queue and no such message means that everything has been
+			// sent.
+			send_queue_->consume(MIDI_OUT_SEND_BATCH_SIZE,
+				[this](const unsigned char* data, size_t len,
+					long long timestamp)
+			{
+				if (timestamp == 0)
+					return dispatch(data, len);
+
+				try
+				{
+					if (!scheduler_->push(data, len, timestamp))
+						return false;
+				}
+				catch (std::bad_alloc&)
+				{
+					WARNING_MESSAGE_W(L"bad_alloc, message dropped\n");
+					return true;
+				}
+				scheduled_messages_.fetch_add(1);
+				return true;
+			});
+
+			// Scheduled and rate-limited messages are sent at once
+			// when the port is closed so that note-offs are not lost.
+			// Chunked SysEx keeps its pacing.
+			const auto stopping
+				{ sender_stop_.load(std::memory_order_relaxed) };
+			send_due(stopping);
+			drain_lanes(stopping);
+			update_timer_period();
+
+			const auto done{ stopping && send_queue_->empty() &&
+				!laned_messages_ };
+			if (!packed_.empty() &&
+				(done || midi_clock::now() >= packed_deadline_))
+				write_packed();
+			else
+				// Wake up flush
+				notifier_.notify();
+
+			if (done)
+				break;
+		}
+
+		DEBUG_MESSAGE_W(L"returns\n");
+	}
+
+	midi_clock::time_point uwp_midiio_port_out::next_deadline() const
+	{
+		auto deadline{ midi_clock::time_point::max() };
+		if (!packed_.empty())
+			deadline = packed_deadline_;
+		if (!scheduler_->empty())
+			deadline = std::min(deadline,
+				from_host_time(scheduler_->top_time()) -
+				midi_clock::duration(schedule_spin_.load()));
+
+		if (sysex_offset_)
+			deadline = std::min(deadline, next_chunk_time_);
+
+		const auto rate{ rate_limit_.load() };
+		if (rate && tokens_ <= 0 && laned_messages_)
+		{
+			// When the bucket has a token again
+			deadline = std::min(deadline, tokens_time_ +
+				std::chrono::duration_cast<midi_clock::duration>(
+				std::chrono::duration<double>((1 - tokens_) / rate)));
+		}
+		return deadline;
+	}
+
+	void uwp_midiio_port_out::send_due(bool all)
+	{
+		const midi_clock::duration spin{ schedule_spin_.load() };
+		while (!scheduler_->empty())
+		{
+			const auto due{ from_host_time(scheduler_->top_time()) };
+			auto now{ midi_clock::now() };
+			if (!all)
+			{
+				if (due > now + spin)
+					break;
+
+				// Sleeping is not precise enough for the last moment.
+				while (now < due)
+				{
+					std::this_thread::yield();
+					now = midi_clock::now();
+				}
+			}
+
+			if (!scheduler_->pop([this](const unsigned char* data,
+				size_t len)
+			{
+				return dispatch(data, len);
+			}))
+			{
+				// The lane is full.
+				if (!all)
+					break;
+				drain_lanes(all);
+				continue;
+			}
+			scheduled_messages_.fetch_sub(1);
+		}
+	}
+
+	bool uwp_midiio_port_out::dispatch(const unsigned char* data,
+		size_t len)
+	{
+		if (!rate_limit_.load() && !sysex_chunk_size_.load())
+		{
+			// Messages limited before go first.
+			drain_lanes(true);
+			deliver(data, len);
+			return true;
+		}
+
+		auto l{ lane::voice };
+		if (len == 1 && data[0] >= 0xf8)
+			l = lane::realtime;
+		else if (len > 3 || is_sysex_piece(data))
+			// SysEx or a continued part of it (including a lone EOX)
+			l = lane::sysex;
+
+		const auto index{ static_cast<size_t>(l) };
+		if (!lanes_[index]->push(data, len, 0))
+		{
+			lane_blocked_ = true;
+			return false;
+		}
+		lane_bytes_[index].fetch_add(len);
+		++laned_messages_;
+		return true;
+	}
+
+	void uwp_midiio_port_out::drain_lanes(bool all)
+	{
+		if (!laned_messages_)
+			return;
+
+		const auto rate{ rate_limit_.load() };
+		const auto now{ midi_clock::now() };
+		if (rate)
+		{
+			const auto burst{ std::max(1.0, rate *
+				std::chrono::duration<double>(
+				MIDI_OUT_RATE_LIMIT_BURST).count()) };
+			tokens_ = std::min(burst, tokens_ + rate *
+				std::chrono::duration<double>(now - tokens_time_).count());
+		}
+		tokens_time_ = now;
+
+		const auto voice{ static_cast<size_t>(lane::voice) };
+		const auto sysex{ static_cast<size_t>(lane::sysex) };
+		for (size_t i = 0; i < LANE_COUNT;)
+		{
+			// A message longer than the bucket is let through
+			// whenever the bucket has a token, and the bucket goes
+			// into debt for it.
+			if (rate && !all && tokens_ <= 0)
+				break;
+
+			// Only realtime messages may interrupt a SysEx,
+			// including one sent in several pieces.
+			if (i == voice && (sysex_offset_ ||
+				(sysex_open_ && !lanes_[sysex]->empty())))
+			{
+				++i;
+				continue;
+			}
+			if (i == sysex && sysex_offset_ && now < next_chunk_time_)
+				break;
+
+			bool sent{ false };
+			lanes_[i]->consume(1,
+				[&](const unsigned char* data, size_t len, long long)
+			{
+				sent = true;
+				if (i != sysex)
+				{
+					deliver(data, len);
+					tokens_ -= static_cast<double>(len);
+					lane_bytes_[i].fetch_sub(len);
+					--laned_messages_;
+					return true;
+				}
+
+				return send_sysex_chunk(data, len, now);
+			});
+			if (!sent)
+			{
+				++i;
+				continue;
+			}
+
+			lane_blocked_ = false;
+			// Higher priority lanes first
+			i = 0;
+		}
+	}
+
+	bool uwp_midiio_port_out::send_sysex_chunk(const unsigned char* data,
+		size_t len, midi_clock::time_point now)
+	{
+		const auto chunk_size{ sysex_chunk_size_.load() };
+		if (sysex_offset_ == 0)
+		{
+			if (!chunk_size || len <= chunk_size)
+			{
+				sysex_open_ = data[len - 1] != 0xf7;
+				deliver(data, len);
+				tokens_ -= static_cast<double>(len);
+				lane_bytes_[static_cast<size_t>(lane::sysex)].fetch_sub(len);
+				--laned_messages_;
+				return true;
+			}
+
+			sysex_total_.store(len);
+			sysex_sent_.store(0);
+			// Chunks bypass deliver, but the SysEx must still
+			// reset the duplicate filter.
+			filter(data, len);
+			// Packed messages go out before the SysEx starts.
+			write_packed();
+		}
+
+		const auto n{ chunk_size ?
+			std::min(chunk_size, len - sysex_offset_) :
+			len - sysex_offset_ };
+		send_buffer(data + sysex_offset_, n);
+		sysex_offset_ += n;
+		sysex_sent_.store(sysex_offset_);
+		tokens_ -= static_cast<double>(n);
+		lane_bytes_[static_cast<size_t>(lane::sysex)].fetch_sub(n);
+		next_chunk_time_ = now + midi_clock::duration(
+			sysex_chunk_interval_.load());
+
+		if (sysex_offset_ < len)
+			return false;
+
+		sysex_open_ = data[len - 1] != 0xf7;
+		sysex_offset_ = 0;
+		--laned_messages_;
+		return true;
+	}
+
+	void uwp_midiio_port_out::deliver(const unsigned char* data,
+		size_t len)
+	{
+		if (!filter(data, len))
+			return;
+
+		if (len == 1 && data[0] >= 0xf8)
+		{
+			// Realtime messages are never delayed.
+			send_buffer(data, len);
+			return;
+		}
+
+		const midi_clock::duration window{ packing_window_.load() };
+		if (window == midi_clock::duration::zero() ||
+			len > 3 || data[0] >= 0xf0 || !(data[0] & 0x80))
+		{
+			// SysEx (including continued parts) and system common
+			// messages go out alone after the packed ones.
+			write_packed();
+			if (!send_buffer(data, len))
+				unfilter();
+			return;
+		}
+
+		if (packed_.size() + len > MIDI_OUT_PACKED_WRITE_SIZE)
+			write_packed();
+		if (packed_.empty())
+			packed_deadline_ = midi_clock::now() + window;
+
+		auto begin{ data };
+		if (running_status_.load() && data[0] == packed_status_)
+			++begin;
+		packed_.insert(packed_.end(), begin, data + len);
+		packed_status_ = data[0];
+		packed_messages_.fetch_add(1);
+	}
+
+	void uwp_midiio_port_out::write_packed()
+	{
+		if (packed_.empty())
+			return;
+
+		if (!send_buffer(packed_.data(), packed_.size()))
+			unfilter();
+		packed_.clear();
+		packed_status_ = 0;
+		packed_messages_.store(0);
+		notifier_.notify();
+	}
+
+	void uwp_midiio_port_out::update_timer_period()
+	{
+		// Sleeping until a scheduled message needs a finer timer
+		// than the default (about 15.6 ms).
+		const auto needed{ !scheduler_->empty() };
+		if (needed == timer_period_)
+			return;
+
+		if (needed)
+			timer_period_ =
+				timeBeginPeriod(MIDI_OUT_TIMER_PERIOD_MS) == TIMERR_NOERROR;
+		else
+		{
+			timeEndPeriod(MIDI_OUT_TIMER_PERIOD_MS);
+			timer_period_ = false;
+		}
+	}
+
+	void uwp_midiio_port_out::release_queues()
+	{
+		send_queue_.reset();
+		scheduler_.reset();
+		for (auto& q : lanes_)
+			q.reset();
+	}
+
+	void uwp_midiio_port_out::stop_sender()
+	{
+		if (!sender_thread_.joinable())
+			return;
+
+		// Queued messages are sent after the connection.
+		// A disconnected device might not come back.
+		wait_open(static_cast<long>(std::chrono::duration_cast<
+			std::chrono::milliseconds>(MIDI_PORT_OPEN_TIMEOUT).count()));
+
+		DEBUG_MESSAGE_W(L"  stopping sender thread\n");
+		sender_stop_.store(true);
+		notifier_.notify();
+		sender_thread_.join();
+		sender_stop_.store(false);
+	}
+
+	Buffer uwp_midiio_port_out::take_buffer(size_t len)
+	{
+		{
+			std::lock_guard<std::mutex> lock(buffers_mtx_);
+
+			if (!buffers_.empty())
+			{
+				auto b{ std::move(buffers_.back()) };
+				buffers_.pop_back();
+				if (b.Capacity() >= len)
+					return b;
+			}
+		}
+
+		// The pool is empty (sent from many threads at once)
+		// or the message is longer than the buffer.
+		// The new buffer replaces the old one in the pool.
+		TRACE_MESSAGE_W(L"  allocating buffer\n");
+		return Buffer(static_cast<uint32_t>(
+			std::max(round_up_power_of_two(len), MIDI_OUT_BUFFER_SIZE)));
+	}
+
+	void uwp_midiio_port_out::return_buffer(Buffer b)
+	{
+		std::lock_guard<std::mutex> lock(buffers_mtx_);
+
+		if (buffers_.size() < MIDI_OUT_BUFFER_POOL_SIZE)
+			buffers_.push_back(std::move(b));
+	}
 }
@@ -36,8 +36,15 @@
 #pragma once
 
 #include "pch.h"
+#include "config.h"
 
+#include "midi_clock.h"
+#include "midi_message_queue.h"
+#include "midi_out_filter.h"
+#include "midi_out_scheduler.h"
+#include "midi_parser.h"
 #include "midi_port.h"
+#include "notifier.h"
 #include "uwp_midiio.h"
 
 namespace uwp_midiio
@@ -48,9 +55,242 @@ namespace uwp_midiio
 		winrt::Windows::Devices::Midi::IMidiOutPort>
 	{
 	public:
+		uwp_midiio_port_out();
+		~uwp_midiio_port_out() override;
+
 		std::wstring find_id_from_display_name(
 			std::wstring_view display_name) override;
 
 		bool send_buffer(const unsigned char* buff, size_t len);
+		// send_buffer through the duplicate filter (synchronous mode)
+		bool send_message(const unsigned char* buff, size_t len);
+		// Sends `buff` to all `ports` (nullptr is skipped).
+		// It is queued to the asynchronous ports first,
+		// then one buffer is sent to all the synchronous ports.
+		// Stores the result for each port to `results` (if not nullptr)
+		// as MIDIOut_PutMIDIMessage returns it.
+		// Returns the number of ports that took the whole message.
+		static size_t send_to_ports(uwp_midiio_port_out* const* ports,
+			size_t count, const unsigned char* buff, size_t len,
+			long* results);
+
+		// Asynchronous mode: messages are queued and sent in order
+		// by a sender thread of the port.
+		// queue_size == 0 goes back to sending synchronously
+		// after the queued messages have been sent.
+		bool set_async(size_t queue_size);
+		bool is_async() const
+		{
+			return static_cast<bool>(send_queue_);
+		}
+		// Splits `buff` into messages (see midi_parser.h) and queues them.
+		// Returns the number of bytes queued,
+		// less than `len` if the queue is full.
+		// Messages with non-zero `timestamp` (host time, see midi_clock.h)
+		// are sent at that time.
+		size_t enqueue(const unsigned char* buff, size_t len,
+			long long timestamp = 0);
+		// Waits until all queued messages have been sent.
+		// Negative timeout means infinite.
+		bool flush(long timeout_ms);
+		size_t queue_depth() const;
+
+		// While the port opened by open_async is connecting
+		// (or reconnecting, see set_reconnect),
+		// messages are buffered up to MIDI_OUT_CONNECT_BUFFER_SIZE bytes
+		// (asynchronous mode: queued) if `buffer` is true,
+		// otherwise rejected.
+		void set_buffer_while_connecting(bool buffer)
+		{
+			buffer_while_connecting_.store(buffer);
+		}
+		// Messages rejected by hold or that did not fit in the buffer
+		unsigned long long lost_messages() const
+		{
+			return lost_messages_.load();
+		}
+		// Returns true if the message is held or rejected because
+		// the port is connecting, with the value for
+		// MIDIOut_PutMIDIMessage in `result`.
+		bool hold(const unsigned char* buff, size_t len, long& result);
+
+		// Wakes up flush and wait_open for closing
+		void begin_close()
+		{
+			closing_.store(true);
+			notifier_.notify();
+			close_wait_open();
+		}
+
+		// Output lanes of the rate limiter in priority order
+		enum class lane
+		{
+			realtime,
+			voice,
+			sysex,
+		};
+		static constexpr size_t LANE_COUNT{ 3 };
+
+		// In asynchronous mode, limits the output to `bytes_per_second`
+		// (0 means unlimited). While limited, realtime messages go first,
+		// then the others except SysEx, then SysEx.
+		void set_rate_limit(size_t bytes_per_second)
+		{
+			rate_limit_.store(bytes_per_second);
+			notifier_.notify();
+		}
+		// Messages waiting for the rate limiter
+		size_t lane_messages(lane l) const
+		{
+			const auto& q{ lanes_[static_cast<size_t>(l)] };
+			return q ? q->size() : 0;
+		}
+		size_t lane_bytes(lane l) const
+		{
+			return lane_bytes_[static_cast<size_t>(l)].load();
+		}
+
+		// In asynchronous mode, sends SysEx longer than `chunk_size`
+		// in chunks at least `interval` apart.
+		// Realtime messages can be sent between the chunks.
+		// Zero chunk size disables it.
+		void set_sysex_chunking(size_t chunk_size,
+			midi_clock::duration interval)
+		{
+			sysex_chunk_interval_.store(interval.count());
+			sysex_chunk_size_.store(chunk_size);
+			notifier_.notify();
+		}
+		// Progress of the SysEx being sent in chunks (or the last one)
+		void sysex_progress(size_t& sent, size_t& total) const
+		{
+			total = sysex_total_.load();
+			sent = sysex_sent_.load();
+		}
+
+		// The sender thread sleeps until `margin` before the time of
+		// a scheduled message and spins for the rest.
+		void set_schedule_spin(midi_clock::duration margin)
+		{
+			schedule_spin_.store(margin.count());
+			notifier_.notify();
+		}
+
+		// In asynchronous mode, packs short messages queued within
+		// `window` into one write, optionally omitting repeated status
+		// bytes (running status). Zero window disables it.
+		void set_packing(midi_clock::duration window, bool running_status)
+		{
+			running_status_.store(running_status);
+			packing_window_.store(window.count());
+		}
+
+		// Drops control change, program change, channel pressure and
+		// pitch bend messages that repeat the value sent less than
+		// `window` ago (see midi_out_filter.h).
+		// Zero window disables it.
+		void set_duplicate_filter(midi_clock::duration window)
+		{
+			filter_clear_.store(true);
+			filter_window_.store(window.count());
+		}
+		unsigned long long saved_bytes() const
+		{
+			return saved_bytes_.load();
+		}
+
+	protected:
+		void finish_open(open_state s) override;
+
+	private:
+		bool filter(const unsigned char* data, size_t len);
+		// After a failed send of a message that passed the filter
+		void unfilter();
+		template<class Send>
+		bool send_filtered(const unsigned char* buff, size_t len,
+			Send&& send);
+		bool write(winrt::Windows::Storage::Streams::Buffer const& b);
+		void send_queued();
+		void stop_sender();
+		midi_clock::time_point next_deadline() const;
+		void send_due(bool all);
+		bool dispatch(const unsigned char* data, size_t len);
+		void drain_lanes(bool all);
+		bool send_sysex_chunk(const unsigned char* data, size_t len,
+			midi_clock::time_point now);
+		void deliver(const unsigned char* data, size_t len);
+		void write_packed();
+		void update_timer_period();
+		void release_queues();
+
+		winrt::Windows::Storage::Streams::Buffer take_buffer(size_t len);
+		void return_buffer(winrt::Windows::Storage::Streams::Buffer b);
+
+		// Filled in place and passed to SendBuffer
+		// so that sending does not allocate in the steady state.
+		std::vector<winrt::Windows::Storage::Streams::Buffer> buffers_;
+		std::mutex buffers_mtx_;
+
+		// Producer: enqueue (host thread)
+		// Consumer: send_queued (sender thread)
+		std::unique_ptr<midi_message_queue> send_queue_;
+		// Used by enqueue only
+		midi_parser parser_;
+		notifier notifier_;
+		std::thread sender_thread_;
+		std::atomic<bool> sender_stop_{ false };
+		std::atomic<bool> closing_{ false };
+
+		// Set by MIDIOut_SetReconnect while other threads may put
+		std::atomic<bool> buffer_while_connecting_{ false };
+		std::atomic<unsigned long long> lost_messages_{ 0 };
+		std::vector<unsigned char> connect_buffer_;
+		std::mutex connect_mtx_;
+
+		std::atomic<midi_clock::rep> packing_window_{ 0 };
+		std::atomic<bool> running_status_{ false };
+		// Removed from the queue but not written yet
+		std::atomic<size_t> packed_messages_{ 0 };
+		std::atomic<size_t> scheduled_messages_{ 0 };
+		std::atomic<midi_clock::rep> schedule_spin_{
+			std::chrono::duration_cast<midi_clock::duration>(
+			MIDI_OUT_SCHEDULE_SPIN_MARGIN).count() };
+
+		std::atomic<size_t> rate_limit_{ 0 };
+		// Producer and consumer: the sender thread
+		std::array<std::unique_ptr<midi_message_queue>, LANE_COUNT> lanes_;
+		std::array<std::atomic<size_t>, LANE_COUNT> lane_bytes_{};
+
+		std::atomic<midi_clock::rep> filter_window_{ 0 };
+		std::atomic<bool> filter_clear_{ false };
+		std::atomic<unsigned long long> saved_bytes_{ 0 };
+		// Used by the sender thread (asynchronous mode)
+		// or under filter_mtx_ (synchronous mode)
+		midi_out_filter filter_;
+		std::mutex filter_mtx_;
+
+		std::atomic<size_t> sysex_chunk_size_{ 0 };
+		std::atomic<midi_clock::rep> sysex_chunk_interval_{ 0 };
+		std::atomic<size_t> sysex_sent_{ 0 };
+		std::atomic<size_t> sysex_total_{ 0 };
+
+		// Used by the sender thread only
+		std::unique_ptr<midi_out_scheduler> scheduler_;
+		std::vector<unsigned char> packed_;
+		unsigned char packed_status_{ 0 };
+		midi_clock::time_point packed_deadline_{};
+		bool timer_period_{ false };
+		// Token bucket of the rate limiter (bytes, may be negative)
+		double tokens_{ 0 };
+		midi_clock::time_point tokens_time_{};
+		// A lane is full, so messages are left in the queue.
+		bool lane_blocked_{ false };
+		size_t laned_messages_{ 0 };
+		// Bytes of the SysEx at the head of the lane already sent
+		size_t sysex_offset_{ 0 };
+		// A piece without EOX has been sent; the voice lane waits
+		// while the rest is in the SysEx lane.
+		bool sysex_open_{ false };
+		midi_clock::time_point next_chunk_time_{};
 	};
 }
@@ -39,93 +39,251 @@
 #include "midi_ports.h"
 
 #include "debug_message.h"
+#include "device_enum.h"
 #include "midi_port_in.h"
 #include "midi_port_out.h"
 #include "uwp_midiio.h"
 
 namespace uwp_midiio
 {
-	std::vector<std::unique_ptr<uwp_midiio_port_in>>
+	uwp_midiio_ports::port_table<uwp_midiio_port_in, MIDIIn>
 		uwp_midiio_ports::ports_in_;
-	std::vector<std::unique_ptr<uwp_midiio_port_out>>
+	uwp_midiio_ports::port_table<uwp_midiio_port_out, MIDIOut>
 		uwp_midiio_ports::ports_out_;
-
-	std::mutex uwp_midiio_ports::mtx_in_;
-	std::mutex uwp_midiio_ports::mtx_out_;
+	epoch_domain uwp_midiio_ports::epoch_;
 
 	template
 	MIDIIn* uwp_midiio_ports::open<uwp_midiio_port_in, MIDIIn>(
+		std::unique_ptr<uwp_midiio_port_in> p,
 		std::wstring_view display_name,
-		std::vector<std::unique_ptr<uwp_midiio_port_in>>& ports,
-		std::mutex& mtx);
+		port_table<uwp_midiio_port_in, MIDIIn>& ports);
 	template
 	MIDIOut* uwp_midiio_ports::open<uwp_midiio_port_out, MIDIOut>(
+		std::unique_ptr<uwp_midiio_port_out> p,
 		std::wstring_view display_name,
-		std::vector<std::unique_ptr<uwp_midiio_port_out>>& ports,
-		std::mutex& mtx);
+		port_table<uwp_midiio_port_out, MIDIOut>& ports);
 
 	template <class uwp_midiio_port_T, class MidiIO_T>
-	static MidiIO_T* uwp_midiio_ports::open(std::wstring_view display_name,
-		std::vector<std::unique_ptr<uwp_midiio_port_T>>& ports,
-		std::mutex& mtx)
+	MidiIO_T* uwp_midiio_ports::open(
+		std::unique_ptr<uwp_midiio_port_T> p,
+		std::wstring_view display_name,
+		port_table<uwp_midiio_port_T, MidiIO_T>& ports)
 	{
 		DEBUG_MESSAGE_W(L"enter \"" << display_name << L"\"\n");
 
-		auto p{ std::make_unique<uwp_midiio_port_T>() };
 		p->open_from_display_name(display_name);
 
-		auto ptr{ p->get_ptr() };
 		if (p->port())
 		{
 			p->set_display_name(display_name);
-			{
-				std::lock_guard<std::mutex> lock(mtx);
 
-				ports.push_back(std::move(p));
+			auto port{ p.get() };
+			auto ptr{ ports.insert(p) };
+			if (ptr)
+			{
+				port->set_handle(ptr);
+				DEBUG_MESSAGE_W(L"returns 0x"
+					<< static_cast<void*>(ptr)
+					<< L", "
+					<< ports.size()
+					<< L" port(s) open\n");
+				return ptr;
 			}
 
-			DEBUG_MESSAGE_W(L"returns 0x"
-				<< static_cast<void*>(ptr)
-				<< L", "
-				<< ports_in_.size()
-				<< L" port(s) open\n");
-			return ptr;
+			WARNING_MESSAGE_W(L"no free handle\n");
 		}
 
 		DEBUG_MESSAGE_W(L"returns nullptr, "
-			<< ports_in_.size()
+			<< ports.size()
 			<< L" port(s) open\n");
 		return nullptr;
 	}
 
+	template
+	MIDIIn* uwp_midiio_ports::open_async<uwp_midiio_port_in, MIDIIn>(
+		std::unique_ptr<uwp_midiio_port_in> p,
+		std::wstring_view display_name,
+		port_table<uwp_midiio_port_in, MIDIIn>& ports,
+		std::function<void(MIDIIn*, open_state)> done);
+	template
+	MIDIOut* uwp_midiio_ports::open_async<uwp_midiio_port_out, MIDIOut>(
+		std::unique_ptr<uwp_midiio_port_out> p,
+		std::wstring_view display_name,
+		port_table<uwp_midiio_port_out, MIDIOut>& ports,
+		std::function<void(MIDIOut*, open_state)> done);
+
+	template <class uwp_midiio_port_T, class MidiIO_T>
+	MidiIO_T* uwp_midiio_ports::open_async(
+		std::unique_ptr<uwp_midiio_port_T> p,
+		std::wstring_view display_name,
+		port_table<uwp_midiio_port_T, MidiIO_T>& ports,
+		std::function<void(MidiIO_T*, open_state)> done)
+	{
+		DEBUG_MESSAGE_W(L"enter \"" << display_name << L"\"\n");
+
+		p->set_display_name(display_name);
+
+		auto port{ p.get() };
+		auto ptr{ ports.insert(p) };
+		if (!ptr)
+		{
+			WARNING_MESSAGE_W(L"no free handle\n");
+			return nullptr;
+		}
+		port->set_handle(ptr);
+		// The thread is started after the handle has been made
+		// so that `done` can get it.
+		port->open_async(display_name,
+			[ptr, done{ std::move(done) }](open_state s)
+		{
+			if (done)
+				done(ptr, s);
+		});
+
+		DEBUG_MESSAGE_W(L"returns 0x"
+			<< static_cast<void*>(ptr)
+			<< L", "
+			<< ports.size()
+			<< L" port(s) open\n");
+		return ptr;
+	}
+
+	size_t uwp_midiio_ports::open_ports(
+		const std::wstring_view* out_names, size_t out_count,
+		MIDIOut** outs, open_state* out_states,
+		const std::wstring_view* in_names, size_t in_count,
+		MIDIIn** ins, open_state* in_states,
+		midi_clock::time_point deadline)
+	{
+		DEBUG_MESSAGE_W(L"enter " << out_count << L", " << in_count
+			<< L"\n");
+
+		// A device connected since the last enumeration is not found
+		// by the open threads, so the devices are enumerated again
+		// here, once for all of them, if a name is missing.
+		const auto missing{ [](const std::wstring_view* names,
+			size_t count, auto find)
+		{
+			for (size_t i = 0; i < count; ++i)
+				if (!names[i].empty() && find(names[i]).empty())
+					return true;
+			return false;
+		} };
+		if (missing(out_names, out_count,
+			device_enum::find_out_id_from_display_name))
+			device_enum::refresh_out_ports();
+		if (missing(in_names, in_count,
+			device_enum::find_in_id_from_display_name))
+			device_enum::refresh_in_ports();
+
+		for (size_t i = 0; i < out_count; ++i)
+		{
+			outs[i] = out_names[i].empty() ? nullptr :
+				open_out_async(out_names[i], false, nullptr);
+		}
+		for (size_t i = 0; i < in_count; ++i)
+		{
+			ins[i] = in_names[i].empty() ? nullptr :
+				open_in_async(in_names[i],
+					midi_message_queue::overflow_policy::drop_oldest,
+					MAX_MIDI_IN_QUEUE_SIZE, nullptr);
+		}
+
+		// The opens run concurrently,
+		// so this takes as long as the slowest one.
+		const auto retval{
+			wait_open(outs, out_states, out_count, deadline, ports_out_) +
+			wait_open(ins, in_states, in_count, deadline, ports_in_) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	template
+	size_t uwp_midiio_ports::wait_open(MIDIIn** ptrs, open_state* states,
+		size_t count, midi_clock::time_point deadline,
+		port_table<uwp_midiio_port_in, MIDIIn>& ports);
+	template
+	size_t uwp_midiio_ports::wait_open(MIDIOut** ptrs, open_state* states,
+		size_t count, midi_clock::time_point deadline,
+		port_table<uwp_midiio_port_out, MIDIOut>& ports);
+
+	template <class uwp_midiio_port_T, class MidiIO_T>
+	size_t uwp_midiio_ports::wait_open(MidiIO_T** ptrs,
+		open_state* states, size_t count, midi_clock::time_point deadline,
+		port_table<uwp_midiio_port_T, MidiIO_T>& ports)
+	{
+		size_t opened{ 0 };
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto s{ open_state::failed };
+			if (ptrs[i])
+			{
+				port_ref<uwp_midiio_port_T> p{ epoch_, ports, ptrs[i] };
+				if (p && deadline == midi_clock::time_point::max())
+					s = p->wait_open(-1);
+				else if (p)
+				{
+					const auto remaining{
+						std::chrono::ceil<std::chrono::milliseconds>(
+							deadline - midi_clock::now()).count() };
+					const auto timeout{ std::clamp<long long>(remaining,
+						0, std::numeric_limits<long>::max()) };
+					s = p->wait_open(static_cast<long>(timeout));
+				}
+			}
+
+			if (s == open_state::failed && ptrs[i])
+			{
+				WARNING_MESSAGE_W(L"failed to open 0x"
+					<< static_cast<void*>(ptrs[i]) << L"\n");
+				close(ptrs[i], ports);
+				ptrs[i] = nullptr;
+			}
+			else if (s == open_state::closed)
+			{
+				// Closed by another thread
+				ptrs[i] = nullptr;
+			}
+			else if (s == open_state::open)
+				++opened;
+			states[i] = s;
+		}
+
+		return opened;
+	}
+
 	template
 	bool uwp_midiio_ports::close(MIDIIn* ptr,
-		std::vector<std::unique_ptr<uwp_midiio_port_in>>& ports,
-		std::mutex& mtx);
+		port_table<uwp_midiio_port_in, MIDIIn>& ports);
 	template
 	bool uwp_midiio_ports::close(MIDIOut* ptr,
-		std::vector<std::unique_ptr<uwp_midiio_port_out>>& ports,
-		std::mutex& mtx);
+		port_table<uwp_midiio_port_out, MIDIOut>& ports);
 
 	template <class uwp_midiio_port_T, class MidiIO_T>
-	static bool uwp_midiio_ports::close(MidiIO_T* ptr,
-		std::vector<std::unique_ptr<uwp_midiio_port_T>>& ports,
-		std::mutex& mtx)
+	bool uwp_midiio_ports::close(MidiIO_T* ptr,
+		port_table<uwp_midiio_port_T, MidiIO_T>& ports)
 	{
 		DEBUG_MESSAGE_W(L"enter 0x" << static_cast<void*>(ptr) << L"\n");
-		std::lock_guard<std::mutex> lock(mtx);
 
-		auto it{ std::find_if(ports.begin(), ports.end(),
-			[ptr](std::unique_ptr<uwp_midiio_port_T>& port)
-			{return port->get_ptr() == ptr; }) };
-		if (it == ports.end())
+		auto p{ ports.erase(ptr) };
+		if (!p)
 		{
 			DEBUG_MESSAGE_W(L"returns false, "
 				<< ports.size()
 				<< L" port(s) open\n");
 			return false;
 		}
-		ports.erase(it);
+		// New calls cannot find the port any more.
+		// Calls in progress are woken up if they wait
+		// and the port is destroyed after they have returned.
+		// The lookups in progress finish first, then no reference
+		// to the port can be added.
+		p->begin_close();
+		epoch_.synchronize();
+		p->drain_refs();
+		p.reset();
 
 		DEBUG_MESSAGE_W(L"returns true, "
 			<< ports.size()
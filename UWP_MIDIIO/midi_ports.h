@@ -36,13 +36,92 @@
 #pragma once
 
 #include "pch.h"
+#include "config.h"
 
+#include "epoch.h"
+#include "handle_table.h"
+#include "midi_clock.h"
 #include "midi_port_in.h"
 #include "midi_port_out.h"
 #include "uwp_midiio.h"
 
 namespace uwp_midiio
 {
+	// An open port found by its handle.
+	// The port is not destroyed while this exists
+	// even if it is closed on another thread.
+	// It counts itself in the port instead of holding an epoch guard,
+	// so that closing waits only for the calls using that port,
+	// not for blocking calls on the other ports.
+	template<class Port_T>
+	class port_ref final
+	{
+	public:
+		port_ref() = default;
+		template<class Table_T, class MidiIO_T>
+		port_ref(epoch_domain& domain, const Table_T& table,
+			const MidiIO_T* handle) :
+			port_(add_ref(domain, table, handle))
+		{
+		}
+		~port_ref()
+		{
+			reset();
+		}
+
+		port_ref(const port_ref&) = delete;
+		port_ref& operator=(const port_ref&) = delete;
+		port_ref(port_ref&& other) noexcept :
+			port_(std::exchange(other.port_, nullptr))
+		{
+		}
+		port_ref& operator=(port_ref&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				port_ = std::exchange(other.port_, nullptr);
+			}
+			return *this;
+		}
+
+		void reset()
+		{
+			if (port_)
+				port_->release_ref();
+			port_ = nullptr;
+		}
+
+		explicit operator bool() const
+		{
+			return port_ != nullptr;
+		}
+		Port_T* operator->() const
+		{
+			return port_;
+		}
+		Port_T* get() const
+		{
+			return port_;
+		}
+
+	private:
+		// The guard keeps the port found from being destroyed
+		// until it has been counted.
+		template<class Table_T, class MidiIO_T>
+		static Port_T* add_ref(epoch_domain& domain, const Table_T& table,
+			const MidiIO_T* handle)
+		{
+			epoch_domain::guard guard{ domain };
+			const auto p{ table.find(handle) };
+			if (p)
+				p->add_ref();
+			return p;
+		}
+
+		Port_T* port_{ nullptr };
+	};
+
 	class uwp_midiio_ports final
 	{
 	public:
@@ -53,42 +132,99 @@ namespace uwp_midiio
 		uwp_midiio_ports(uwp_midiio_ports&&) = delete;
 		uwp_midiio_ports& operator=(uwp_midiio_ports&&) = delete;
 
-		static MIDIIn* open_in(std::wstring_view display_name)
+		static MIDIIn* open_in(std::wstring_view display_name,
+			midi_message_queue::overflow_policy policy =
+			midi_message_queue::overflow_policy::drop_oldest,
+			size_t queue_size = MAX_MIDI_IN_QUEUE_SIZE)
 		{
-			return open<uwp_midiio_port_in, MIDIIn>(
-				display_name, ports_in_, mtx_in_);
+			return open(
+				std::make_unique<uwp_midiio_port_in>(policy, queue_size),
+				display_name, ports_in_);
 		}
 		static MIDIOut* open_out(std::wstring_view display_name)
 		{
-			return open<uwp_midiio_port_out, MIDIOut>(
-				display_name, ports_out_, mtx_out_);
+			return open(std::make_unique<uwp_midiio_port_out>(),
+				display_name, ports_out_);
 		}
+		// Return the handle at once (nullptr if there is no free handle).
+		// The port is opened in a thread, then `done` is called from it.
+		static MIDIIn* open_in_async(std::wstring_view display_name,
+			midi_message_queue::overflow_policy policy, size_t queue_size,
+			std::function<void(MIDIIn*, open_state)> done)
+		{
+			return open_async(
+				std::make_unique<uwp_midiio_port_in>(policy, queue_size),
+				display_name, ports_in_, std::move(done));
+		}
+		static MIDIOut* open_out_async(std::wstring_view display_name,
+			bool buffer, std::function<void(MIDIOut*, open_state)> done)
+		{
+			auto p{ std::make_unique<uwp_midiio_port_out>() };
+			p->set_buffer_while_connecting(buffer);
+			return open_async(std::move(p), display_name, ports_out_,
+				std::move(done));
+		}
+		// Opens all the ports at once (see open_in_async and
+		// open_out_async) and waits for them until `deadline`.
+		// Ports that have failed are closed and their handles are
+		// nullptr. Ports still connecting at the deadline are left open.
+		// Stores the handle and the state of each port to
+		// `outs`/`out_states` and `ins`/`in_states`.
+		// Returns the number of ports opened.
+		static size_t open_ports(
+			const std::wstring_view* out_names, size_t out_count,
+			MIDIOut** outs, open_state* out_states,
+			const std::wstring_view* in_names, size_t in_count,
+			MIDIIn** ins, open_state* in_states,
+			midi_clock::time_point deadline);
 		static bool close_in(MIDIIn* ptr)
 		{
-			return close<uwp_midiio_port_in, MIDIIn>(
-				ptr, ports_in_, mtx_in_);
+			return close(ptr, ports_in_);
 		}
 		static bool close_out(MIDIOut* ptr)
 		{
-			return close<uwp_midiio_port_out, MIDIOut>(
-				ptr, ports_out_, mtx_out_);
+			return close(ptr, ports_out_);
+		}
+
+		// Empty if `ptr` is not an open port
+		// (never opened or already closed).
+		// Lock-free: closing waits until the returned references are gone.
+		static port_ref<uwp_midiio_port_in> find_in(const MIDIIn* ptr)
+		{
+			return { epoch_, ports_in_, ptr };
+		}
+		static port_ref<uwp_midiio_port_out> find_out(const MIDIOut* ptr)
+		{
+			return { epoch_, ports_out_, ptr };
 		}
 
 	private:
 		template <class uwp_midiio_port_T, class MidiIO_T>
-		static MidiIO_T* open(std::wstring_view display_name,
-			std::vector<std::unique_ptr<uwp_midiio_port_T>>& ports,
-			std::mutex& mtx);
+		using port_table = handle_table<uwp_midiio_port_T, MidiIO_T,
+			MIDI_PORT_HANDLE_SLOTS, MIDI_PORT_HANDLE_GENERATIONS>;
 
 		template <class uwp_midiio_port_T, class MidiIO_T>
-		static bool close(MidiIO_T* ptr,
-			std::vector<std::unique_ptr<uwp_midiio_port_T>>& ports,
-			std::mutex& mtx);
+		static MidiIO_T* open(std::unique_ptr<uwp_midiio_port_T> p,
+			std::wstring_view display_name,
+			port_table<uwp_midiio_port_T, MidiIO_T>& ports);
 
-		static std::vector<std::unique_ptr<uwp_midiio_port_in>> ports_in_;
-		static std::vector<std::unique_ptr<uwp_midiio_port_out>> ports_out_;
+		template <class uwp_midiio_port_T, class MidiIO_T>
+		static MidiIO_T* open_async(std::unique_ptr<uwp_midiio_port_T> p,
+			std::wstring_view display_name,
+			port_table<uwp_midiio_port_T, MidiIO_T>& ports,
+			std::function<void(MidiIO_T*, open_state)> done);
+
+		template <class uwp_midiio_port_T, class MidiIO_T>
+		static size_t wait_open(MidiIO_T** ptrs, open_state* states,
+			size_t count, midi_clock::time_point deadline,
+			port_table<uwp_midiio_port_T, MidiIO_T>& ports);
+
+		template <class uwp_midiio_port_T, class MidiIO_T>
+		static bool close(MidiIO_T* ptr,
+			port_table<uwp_midiio_port_T, MidiIO_T>& ports);
 
-		static std::mutex mtx_in_;
-		static std::mutex mtx_out_;
+		static port_table<uwp_midiio_port_in, MIDIIn> ports_in_;
+		static port_table<uwp_midiio_port_out, MIDIOut> ports_out_;
+		static epoch_domain epoch_;
 	};
 }
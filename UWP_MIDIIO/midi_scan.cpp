@@ -0,0 +1,150 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_scan.cpp:
+//   Status byte scanning
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+#include "config.h"
+
+#include "midi_scan.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define UWP_MIDIIO_SCAN_SIMD
+#endif
+
+#ifdef UWP_MIDIIO_SCAN_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#define UWP_MIDIIO_TARGET_AVX2
+#else
+// GCC and Clang (Linux tests) compile the kernels for their own targets.
+#include <immintrin.h>
+#define UWP_MIDIIO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace uwp_midiio
+{
+#ifdef UWP_MIDIIO_SCAN_SIMD
+	namespace
+	{
+		// `mask` must not be 0.
+		inline unsigned long first_set_bit(unsigned long mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return static_cast<unsigned long>(__builtin_ctzl(mask));
+#endif
+		}
+
+		// x64 always has SSE2.
+		const unsigned char* find_status_sse2(const unsigned char* p,
+			const unsigned char* end)
+		{
+			while (end - p >= 16)
+			{
+				const auto mask{ static_cast<unsigned long>(
+					_mm_movemask_epi8(_mm_loadu_si128(
+					reinterpret_cast<const __m128i*>(p)))) };
+				if (mask)
+					return p + first_set_bit(mask);
+				p += 16;
+			}
+			return find_status_scalar(p, end);
+		}
+
+		UWP_MIDIIO_TARGET_AVX2
+		const unsigned char* find_status_avx2(const unsigned char* p,
+			const unsigned char* end)
+		{
+			while (end - p >= 32)
+			{
+				const auto mask{ static_cast<unsigned long>(
+					static_cast<unsigned int>(
+					_mm256_movemask_epi8(_mm256_loadu_si256(
+					reinterpret_cast<const __m256i*>(p))))) };
+				if (mask)
+					return p + first_set_bit(mask);
+				p += 32;
+			}
+			return find_status_sse2(p, end);
+		}
+
+		bool has_avx2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+
+			// The OS must save the YMM registers (OSXSAVE and XCR0).
+			__cpuid(info, 1);
+			constexpr int OSXSAVE_AVX{ (1 << 27) | (1 << 28) };
+			if ((info[2] & OSXSAVE_AVX) != OSXSAVE_AVX ||
+				(_xgetbv(0) & 0x6) != 0x6)
+				return false;
+
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			// Also checks that the OS saves the YMM registers.
+			// find_status_impl is initialised before main().
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+
+		using find_status_function = const unsigned char* (*)(
+			const unsigned char*, const unsigned char*);
+
+		const find_status_function find_status_impl
+			{ has_avx2() ? find_status_avx2 : find_status_sse2 };
+	}
+#endif
+
+	const unsigned char* find_status(const unsigned char* p,
+		const unsigned char* end)
+	{
+#ifdef UWP_MIDIIO_SCAN_SIMD
+		if (static_cast<size_t>(end - p) < MIDI_SCAN_SIMD_MIN_SIZE)
+			return find_status_scalar(p, end);
+		return find_status_impl(p, end);
+#else
+		return find_status_scalar(p, end);
+#endif
+	}
+}
@@ -0,0 +1,120 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// notifier.h:
+//   Wait/notify helper class `notifier`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace uwp_midiio
+{
+	// Lets threads sleep until a lock-free producer publishes something.
+	// notify() costs a fence and a load while nobody is waiting,
+	// and waiters do not sleep at all while the predicate is true.
+	class notifier final
+	{
+	public:
+		notifier() = default;
+
+		notifier(const notifier&) = delete;
+		notifier& operator=(const notifier&) = delete;
+		notifier(notifier&&) = delete;
+		notifier& operator=(notifier&&) = delete;
+
+		// Call after publishing the data the predicate checks.
+		void notify()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiters_.load(std::memory_order_relaxed) == 0)
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(mtx_);
+			}
+			cv_.notify_all();
+		}
+
+		template<class Pred>
+		void wait(Pred pred)
+		{
+			if (pred())
+				return;
+
+			waiter w{ waiters_ };
+			std::unique_lock<std::mutex> lock(mtx_);
+			cv_.wait(lock, pred);
+		}
+
+		template<class Pred>
+		bool wait_until(std::chrono::steady_clock::time_point deadline,
+			Pred pred)
+		{
+			if (pred())
+				return true;
+
+			waiter w{ waiters_ };
+			std::unique_lock<std::mutex> lock(mtx_);
+			return cv_.wait_until(lock, deadline, pred);
+		}
+
+	private:
+		class waiter final
+		{
+		public:
+			explicit waiter(std::atomic<int>& waiters) :
+				waiters_(waiters)
+			{
+				waiters_.fetch_add(1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+			~waiter()
+			{
+				waiters_.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			waiter(const waiter&) = delete;
+			waiter& operator=(const waiter&) = delete;
+
+		private:
+			std::atomic<int>& waiters_;
+		};
+
+		std::atomic<int> waiters_{ 0 };
+		std::mutex mtx_;
+		std::condition_variable cv_;
+	};
+}
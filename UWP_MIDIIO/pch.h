@@ -37,19 +37,29 @@
 #define PCH_H
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <regex>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include <cstring>
 
+#ifdef UWP_MIDIIO_FAKE_WINRT
+// Linux tests (tests/Makefile) use a fake WinRT/Win32 backend.
+#include "fake_winrt.h"
+#else
 #include <winrt/base.h>
 #include <winrt/Windows.Foundation.h>
 #include <winrt/Windows.Foundation.Collections.h>
@@ -59,5 +69,6 @@
 #include <winrt/Windows.Security.Cryptography.h>
 
 #include "framework.h"
+#endif
 
 #endif //PCH_H
@@ -0,0 +1,213 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// spsc_ring.h:
+//   Lock-free single-producer/single-consumer ring buffer `spsc_ring`
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace uwp_midiio
+{
+	constexpr size_t CACHE_LINE_SIZE{ 64 };
+
+	constexpr size_t round_up_power_of_two(size_t n)
+	{
+		size_t retval{ 1 };
+		while (retval < n)
+			retval <<= 1;
+		return retval;
+	}
+
+	// Bounded lock-free ring buffer.
+	// Exactly one thread may push (producer) and exactly one thread may pop
+	// (consumer) at the same time.
+	// The capacity is rounded up to a power of two.
+	template<class T>
+	class alignas(CACHE_LINE_SIZE) spsc_ring final
+	{
+	public:
+		explicit spsc_ring(size_t capacity) :
+			capacity_(round_up_power_of_two(capacity)),
+			mask_(capacity_ - 1),
+			buffer_(std::make_unique<T[]>(capacity_))
+		{
+		}
+
+		spsc_ring(const spsc_ring&) = delete;
+		spsc_ring& operator=(const spsc_ring&) = delete;
+		spsc_ring(spsc_ring&&) = delete;
+		spsc_ring& operator=(spsc_ring&&) = delete;
+
+		// Producer side
+		bool push(T&& value)
+		{
+			const auto slot{ reserve() };
+			if (!slot)
+				return false;
+
+			*slot = std::move(value);
+			commit();
+			return true;
+		}
+		// Returns the slot for the next element to be filled in place,
+		// or nullptr if the ring is full.
+		T* reserve()
+		{
+			const auto tail{ tail_.load(std::memory_order_relaxed) };
+			if (tail - cached_head_ >= capacity_)
+			{
+				cached_head_ = head_.load(std::memory_order_acquire);
+				if (tail - cached_head_ >= capacity_)
+					return nullptr;
+			}
+
+			return &buffer_[tail & mask_];
+		}
+		// Publishes the slot returned by reserve().
+		void commit()
+		{
+			tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+				std::memory_order_release);
+		}
+
+		// Consumer side
+		bool pop(T& value)
+		{
+			const auto head{ head_.load(std::memory_order_relaxed) };
+			if (head == cached_tail_)
+			{
+				cached_tail_ = tail_.load(std::memory_order_acquire);
+				if (head == cached_tail_)
+					return false;
+			}
+
+			value = std::move(buffer_[head & mask_]);
+			buffer_[head & mask_] = T{};
+			head_.store(head + 1, std::memory_order_release);
+			return true;
+		}
+		// Returns the oldest element without removing it, or nullptr.
+		// The element stays valid until pop_front().
+		T* front()
+		{
+			const auto head{ head_.load(std::memory_order_relaxed) };
+			if (head == cached_tail_)
+			{
+				cached_tail_ = tail_.load(std::memory_order_acquire);
+				if (head == cached_tail_)
+					return nullptr;
+			}
+
+			return &buffer_[head & mask_];
+		}
+		// Must be preceded by a successful front().
+		void pop_front()
+		{
+			pop_front(1);
+		}
+		// Returns the number of elements that can be read by peek().
+		size_t available()
+		{
+			cached_tail_ = tail_.load(std::memory_order_acquire);
+			return cached_tail_ - head_.load(std::memory_order_relaxed);
+		}
+		// Returns the element at the offset from the oldest one.
+		// The offset must be less than the value returned by available().
+		T& peek(size_t offset)
+		{
+			return buffer_[(head_.load(std::memory_order_relaxed) + offset)
+				& mask_];
+		}
+		// Removes the n oldest elements at once.
+		void pop_front(size_t n)
+		{
+			head_.store(head_.load(std::memory_order_relaxed) + n,
+				std::memory_order_release);
+		}
+
+		// For a queue whose producer also removes the oldest elements
+		// (midi_message_queue with overflow_policy::drop_oldest).
+		// The sides must agree on disjoint ranges from the oldest one,
+		// since each range is released only by its length.
+		size_t head() const
+		{
+			return head_.load(std::memory_order_acquire);
+		}
+		size_t tail() const
+		{
+			return tail_.load(std::memory_order_acquire);
+		}
+		// The element at an index between head() and tail()
+		T& at(size_t index)
+		{
+			return buffer_[index & mask_];
+		}
+		void release_front(size_t n)
+		{
+			head_.fetch_add(n, std::memory_order_release);
+		}
+
+		// Either side (approximate while the other side is running)
+		size_t size() const
+		{
+			const auto head{ head_.load(std::memory_order_acquire) };
+			const auto tail{ tail_.load(std::memory_order_acquire) };
+			return tail - head;
+		}
+		bool empty() const
+		{
+			return size() == 0;
+		}
+		size_t capacity() const
+		{
+			return capacity_;
+		}
+
+	private:
+		const size_t capacity_;
+		const size_t mask_;
+		const std::unique_ptr<T[]> buffer_;
+
+		// Written by the consumer (and by the producer in release_front)
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{ 0 };
+		size_t cached_tail_{ 0 };
+
+		// Written by the producer only
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{ 0 };
+		size_t cached_head_{ 0 };
+	};
+}
@@ -40,6 +40,7 @@
 
 #include "debug_message.h"
 #include "device_enum.h"
+#include "midi_clock.h"
 #include "midi_port_in.h"
 #include "midi_port_out.h"
 #include "midi_ports.h"
@@ -133,12 +134,33 @@ UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_PutMIDIMessage(
 {
 	TRACE_MESSAGE_W(L"enter\n");
 
-	auto port_ptr{ uwp_midiio::uwp_midiio_port_out::get_class(pMIDI) };
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDI) };
 	if (port_ptr)
 	{
-		TRACE_MESSAGE_W(L"	trying send_buffer\n");
+		long held;
+		if (lLen > 0 && port_ptr->hold(pMessage, lLen, held))
+		{
+			TRACE_MESSAGE_W(L"returns " << held << L" (connecting)\n");
+			return held;
+		}
+
+		if (port_ptr->is_async() && lLen > 0)
+		{
+			const auto queued{ static_cast<long>(
+				port_ptr->enqueue(pMessage, lLen)) };
+			if (!queued)
+			{
+				TRACE_MESSAGE_W(L"returns MIDIIO_ERROR_QUEUE_FULL\n");
+				return MIDIIO_ERROR_QUEUE_FULL;
+			}
 
-		if (port_ptr->send_buffer(pMessage, lLen))
+			TRACE_MESSAGE_W(L"returns " << queued << L"\n");
+			return queued;
+		}
+
+		TRACE_MESSAGE_W(L"	trying send_message\n");
+
+		if (port_ptr->send_message(pMessage, lLen))
 		{
 			TRACE_MESSAGE_W(L"returns " << lLen << L"\n");
 			return lLen;
@@ -238,7 +260,7 @@ UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessage(
 {
 	// TRACE_MESSAGE_W(L"enter\n");
 
-	auto port_ptr{ uwp_midiio::uwp_midiio_port_in::get_class(pMIDIIn) };
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
 	if (port_ptr)
 	{
 		// TRACE_MESSAGE_W(L"  trying pop_message\n");
@@ -250,6 +272,904 @@ UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessage(
 		return retval;
 	}
 
-	WARNING_MESSAGE_W(L"port_prt is nullptr\n");
+	WARNING_MESSAGE_W(L"invalid handle\n");
 	return 0;
 }
+
+UWP_MIDIIO_DECLSPEC long long UWP_MIDIIO_API MIDIIO_GetTime()
+{
+	return uwp_midiio::host_time_now();
+}
+
+static bool to_overflow_policy(long lOverflowPolicy,
+	uwp_midiio::midi_message_queue::overflow_policy& policy)
+{
+	using overflow_policy =
+		uwp_midiio::midi_message_queue::overflow_policy;
+	switch (lOverflowPolicy)
+	{
+	case MIDIIO_OVERFLOW_DROP_OLDEST:
+		policy = overflow_policy::drop_oldest;
+		return true;
+	case MIDIIO_OVERFLOW_DROP_NEWEST:
+		policy = overflow_policy::drop_newest;
+		return true;
+	case MIDIIO_OVERFLOW_KEEP_REALTIME_SYSEX:
+		policy = overflow_policy::keep_realtime_sysex;
+		return true;
+	case MIDIIO_OVERFLOW_GROW:
+		policy = overflow_policy::grow;
+		return true;
+	}
+	return false;
+}
+
+static size_t to_in_queue_size(long lQueueSize)
+{
+	if (lQueueSize > 0)
+	{
+		return std::min(static_cast<size_t>(lQueueSize),
+			uwp_midiio::MIDI_QUEUE_SIZE_HARD_LIMIT);
+	}
+	return uwp_midiio::MAX_MIDI_IN_QUEUE_SIZE;
+}
+
+UWP_MIDIIO_DECLSPEC MIDIIn* UWP_MIDIIO_API MIDIIn_OpenExW(
+	const wchar_t* pszDeviceName, long lOverflowPolicy, long lQueueSize)
+{
+	DEBUG_MESSAGE_W(L"enter \"" << pszDeviceName << L"\", "
+		<< lOverflowPolicy << L", " << lQueueSize << L"\n");
+
+	uwp_midiio::midi_message_queue::overflow_policy policy;
+	if (!to_overflow_policy(lOverflowPolicy, policy))
+	{
+		WARNING_MESSAGE_W(L"unknown overflow policy\n");
+		return nullptr;
+	}
+	const auto queue_size{ to_in_queue_size(lQueueSize) };
+
+	if (!pszDeviceName)
+	{
+		DEBUG_MESSAGE_W(L"returns nullptr\n");
+		return nullptr;
+	}
+	std::wstring_view display_name{ pszDeviceName };
+	if (display_name.size() == 0)
+	{
+		DEBUG_MESSAGE_W(L"returns nullptr\n");
+		return nullptr;
+	}
+
+	auto retval{ uwp_midiio::uwp_midiio_ports::open_in(
+		display_name, policy, queue_size) };
+
+	DEBUG_MESSAGE_W(L"returns 0x" << static_cast<void*>(retval) << L"\n");
+	return retval;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetDroppedCount(
+	MIDIIn* pMIDIIn, long long* pMessages, long long* pBytes)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		if (pMessages)
+			*pMessages =
+				static_cast<long long>(port_ptr->dropped_messages());
+		if (pBytes)
+			*pBytes = static_cast<long long>(port_ptr->dropped_bytes());
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessageEx(
+	MIDIIn* pMIDIIn, unsigned char* pMessage, long lLen,
+	long long* pTimestamp)
+{
+	// TRACE_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		auto retval{ static_cast<long>(
+			port_ptr->pop_message(pMessage, lLen, pTimestamp)) };
+
+		// TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessages(
+	MIDIIn* pMIDIIn, unsigned char* pBuffer, long lLen,
+	long* pLengths, long long* pTimestamps, long lMaxCount)
+{
+	// TRACE_MESSAGE_W(L"enter\n");
+
+	if (!pBuffer || lLen <= 0 || !pLengths || lMaxCount <= 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		// TRACE_MESSAGE_W(L"  trying pop_messages\n");
+
+		auto retval{ static_cast<long>(port_ptr->pop_messages(
+			pBuffer, lLen, pLengths, pTimestamps, lMaxCount)) };
+
+		// TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessagePartial(
+	MIDIIn* pMIDIIn, unsigned char* pMessage, long lLen,
+	long* plRemaining, long long* pTimestamp)
+{
+	// TRACE_MESSAGE_W(L"enter\n");
+
+	if (plRemaining)
+		*plRemaining = 0;
+	if (!pMessage || lLen <= 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		size_t remaining{ 0 };
+		bool dropped{ false };
+		auto retval{ static_cast<long>(port_ptr->pop_partial(
+			pMessage, lLen, &remaining, pTimestamp, &dropped)) };
+		if (dropped)
+			return MIDIIO_ERROR_MESSAGE_DROPPED;
+		if (plRemaining)
+			*plRemaining = static_cast<long>(remaining);
+
+		// TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_PeekMIDIMessageLength(
+	MIDIIn* pMIDIIn)
+{
+	// TRACE_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		auto retval{ static_cast<long>(port_ptr->peek_length()) };
+
+		// TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_WaitMIDIMessage(
+	MIDIIn* pMIDIIn, long lTimeout)
+{
+	TRACE_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		auto retval{ static_cast<long>(port_ptr->wait_message(lTimeout)) };
+
+		TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_WaitMIDIMessageMulti(
+	MIDIIn** ppMIDIIn, long lCount, long lTimeout)
+{
+	TRACE_MESSAGE_W(L"enter\n");
+
+	if (!ppMIDIIn || lCount <= 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return -1;
+	}
+
+	auto retval{ uwp_midiio::uwp_midiio_port_in::wait_any(
+		ppMIDIIn, lCount, lTimeout) };
+
+	TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+	return retval;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_SetCallback(
+	MIDIIn* pMIDIIn, MIDIIn_Callback pCallback, void* pUser)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		auto retval{ static_cast<long>(
+			port_ptr->set_callback(pCallback, pUser)) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetAsync(
+	MIDIOut* pMIDIOut, long bEnable, long lQueueSize)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	size_t queue_size{ 0 };
+	if (bEnable)
+	{
+		queue_size = uwp_midiio::MIDI_OUT_QUEUE_SIZE;
+		if (lQueueSize > 0)
+		{
+			queue_size = std::min(static_cast<size_t>(lQueueSize),
+				uwp_midiio::MIDI_QUEUE_SIZE_HARD_LIMIT);
+		}
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		auto retval{ static_cast<long>(port_ptr->set_async(queue_size)) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_PutMIDIMessageAt(
+	MIDIOut* pMIDI, unsigned char* pMessage, long lLen, long long llTime)
+{
+	TRACE_MESSAGE_W(L"enter " << llTime << L"\n");
+
+	if (!pMessage || lLen <= 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDI) };
+	if (port_ptr)
+	{
+		if (!port_ptr->is_async())
+		{
+			WARNING_MESSAGE_W(L"not in asynchronous mode\n");
+			return 0;
+		}
+
+		long held;
+		if (port_ptr->hold(pMessage, lLen, held))
+		{
+			TRACE_MESSAGE_W(L"returns " << held << L" (connecting)\n");
+			return held;
+		}
+
+		// 0 means "not scheduled" in the queue.
+		const auto queued{ static_cast<long>(
+			port_ptr->enqueue(pMessage, lLen, std::max(llTime, 1LL))) };
+		if (!queued)
+		{
+			TRACE_MESSAGE_W(L"returns MIDIIO_ERROR_QUEUE_FULL\n");
+			return MIDIIO_ERROR_QUEUE_FULL;
+		}
+
+		TRACE_MESSAGE_W(L"returns " << queued << L"\n");
+		return queued;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetScheduleSpin(
+	MIDIOut* pMIDIOut, long lMargin)
+{
+	DEBUG_MESSAGE_W(L"enter " << lMargin << L"\n");
+
+	if (lMargin < 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		port_ptr->set_schedule_spin(std::chrono::microseconds(lMargin));
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_Flush(
+	MIDIOut* pMIDIOut, long lTimeout)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		auto retval{ static_cast<long>(port_ptr->flush(lTimeout)) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetQueueDepth(
+	MIDIOut* pMIDIOut)
+{
+	// TRACE_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		auto retval{ static_cast<long>(port_ptr->queue_depth()) };
+
+		// TRACE_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetPacking(
+	MIDIOut* pMIDIOut, long lWindow, long bRunningStatus)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	if (lWindow < 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		port_ptr->set_packing(std::chrono::microseconds(lWindow),
+			bRunningStatus != 0);
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetRateLimit(
+	MIDIOut* pMIDIOut, long lBytesPerSecond)
+{
+	DEBUG_MESSAGE_W(L"enter " << lBytesPerSecond << L"\n");
+
+	if (lBytesPerSecond < 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		port_ptr->set_rate_limit(static_cast<size_t>(lBytesPerSecond));
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetLaneBacklog(
+	MIDIOut* pMIDIOut, long lLane, long long* pMessages, long long* pBytes)
+{
+	// TRACE_MESSAGE_W(L"enter\n");
+
+	using lane = uwp_midiio::uwp_midiio_port_out::lane;
+	if (lLane < 0 ||
+		static_cast<size_t>(lLane) >=
+		uwp_midiio::uwp_midiio_port_out::LANE_COUNT)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		const auto l{ static_cast<lane>(lLane) };
+		if (pMessages)
+			*pMessages = static_cast<long long>(port_ptr->lane_messages(l));
+		if (pBytes)
+			*pBytes = static_cast<long long>(port_ptr->lane_bytes(l));
+
+		// TRACE_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetSysExChunking(
+	MIDIOut* pMIDIOut, long lChunkSize, long lInterval)
+{
+	DEBUG_MESSAGE_W(L"enter " << lChunkSize << L", " << lInterval << L"\n");
+
+	if (lChunkSize < 0 || lInterval < 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		port_ptr->set_sysex_chunking(static_cast<size_t>(lChunkSize),
+			std::chrono::microseconds(lInterval));
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetSysExProgress(
+	MIDIOut* pMIDIOut, long long* pSent, long long* pTotal)
+{
+	// TRACE_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		size_t sent;
+		size_t total;
+		port_ptr->sysex_progress(sent, total);
+		if (pSent)
+			*pSent = static_cast<long long>(sent);
+		if (pTotal)
+			*pTotal = static_cast<long long>(total);
+
+		// TRACE_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_PutMIDIMessageMulti(
+	MIDIOut** ppMIDIOut, long lCount, unsigned char* pMessage, long lLen,
+	long* pResults)
+{
+	TRACE_MESSAGE_W(L"enter " << lCount << L"\n");
+
+	if (!ppMIDIOut || lCount <= 0 || !pMessage || lLen <= 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	// The references keep the ports of a batch from being destroyed
+	// while it is sent, and closing one of them waits only for that.
+	std::array<uwp_midiio::port_ref<uwp_midiio::uwp_midiio_port_out>,
+		uwp_midiio::MIDI_OUT_MULTI_BATCH_SIZE> refs;
+	std::array<uwp_midiio::uwp_midiio_port_out*,
+		uwp_midiio::MIDI_OUT_MULTI_BATCH_SIZE> ports;
+	long sent{ 0 };
+	for (long i = 0; i < lCount;)
+	{
+		const auto results{ pResults ? pResults + i : nullptr };
+		size_t n{ 0 };
+		for (; n < ports.size() && i < lCount; ++n, ++i)
+		{
+			refs[n] = uwp_midiio::uwp_midiio_ports::find_out(ppMIDIOut[i]);
+			ports[n] = refs[n].get();
+		}
+
+		sent += static_cast<long>(uwp_midiio::uwp_midiio_port_out::
+			send_to_ports(ports.data(), n, pMessage, lLen, results));
+		for (size_t j = 0; j < n; ++j)
+			refs[j].reset();
+	}
+
+	TRACE_MESSAGE_W(L"returns " << sent << L"\n");
+	return sent;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetDuplicateFilter(
+	MIDIOut* pMIDIOut, long lWindow, long long* pSavedBytes)
+{
+	DEBUG_MESSAGE_W(L"enter " << lWindow << L"\n");
+
+	if (lWindow < 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		port_ptr->set_duplicate_filter(std::chrono::microseconds(lWindow));
+		if (pSavedBytes)
+			*pSavedBytes =
+				static_cast<long long>(port_ptr->saved_bytes());
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_SetCoalescing(
+	MIDIIn* pMIDIIn, long lThreshold, long long* pCoalesced)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	if (lThreshold < 0)
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		port_ptr->set_coalescing(static_cast<size_t>(lThreshold));
+		if (pCoalesced)
+			*pCoalesced =
+				static_cast<long long>(port_ptr->coalesced_messages());
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+static long to_status(uwp_midiio::open_state s)
+{
+	switch (s)
+	{
+	case uwp_midiio::open_state::connecting:
+		return MIDIIO_STATUS_CONNECTING;
+	case uwp_midiio::open_state::open:
+		return MIDIIO_STATUS_OPEN;
+	case uwp_midiio::open_state::failed:
+		return MIDIIO_STATUS_FAILED;
+	case uwp_midiio::open_state::closed:
+		return MIDIIO_STATUS_CLOSED;
+	}
+	return MIDIIO_STATUS_FAILED;
+}
+
+UWP_MIDIIO_DECLSPEC MIDIOut* UWP_MIDIIO_API MIDIOut_OpenAsyncW(
+	const wchar_t* pszDeviceName, long lFlags,
+	MIDIIO_OpenCallback pCallback, void* pUser)
+{
+	DEBUG_MESSAGE_W(L"enter \"" << pszDeviceName << L"\", "
+		<< lFlags << L"\n");
+
+	if (!pszDeviceName)
+	{
+		DEBUG_MESSAGE_W(L"returns nullptr\n");
+		return nullptr;
+	}
+	std::wstring_view display_name{ pszDeviceName };
+	if (display_name.size() == 0)
+	{
+		DEBUG_MESSAGE_W(L"returns nullptr\n");
+		return nullptr;
+	}
+
+	auto retval{ uwp_midiio::uwp_midiio_ports::open_out_async(
+		display_name, (lFlags & MIDIIO_OPEN_BUFFER) != 0,
+		[pCallback, pUser](MIDIOut* ptr, uwp_midiio::open_state s)
+	{
+		if (pCallback)
+			pCallback(ptr, to_status(s), pUser);
+	}) };
+
+	DEBUG_MESSAGE_W(L"returns 0x" << static_cast<void*>(retval) << L"\n");
+	return retval;
+}
+
+UWP_MIDIIO_DECLSPEC MIDIIn* UWP_MIDIIO_API MIDIIn_OpenAsyncW(
+	const wchar_t* pszDeviceName, long lOverflowPolicy, long lQueueSize,
+	MIDIIO_OpenCallback pCallback, void* pUser)
+{
+	DEBUG_MESSAGE_W(L"enter \"" << pszDeviceName << L"\", "
+		<< lOverflowPolicy << L", " << lQueueSize << L"\n");
+
+	uwp_midiio::midi_message_queue::overflow_policy policy;
+	if (!to_overflow_policy(lOverflowPolicy, policy))
+	{
+		WARNING_MESSAGE_W(L"unknown overflow policy\n");
+		return nullptr;
+	}
+	const auto queue_size{ to_in_queue_size(lQueueSize) };
+
+	if (!pszDeviceName)
+	{
+		DEBUG_MESSAGE_W(L"returns nullptr\n");
+		return nullptr;
+	}
+	std::wstring_view display_name{ pszDeviceName };
+	if (display_name.size() == 0)
+	{
+		DEBUG_MESSAGE_W(L"returns nullptr\n");
+		return nullptr;
+	}
+
+	auto retval{ uwp_midiio::uwp_midiio_ports::open_in_async(
+		display_name, policy, queue_size,
+		[pCallback, pUser](MIDIIn* ptr, uwp_midiio::open_state s)
+	{
+		if (pCallback)
+			pCallback(ptr, to_status(s), pUser);
+	}) };
+
+	DEBUG_MESSAGE_W(L"returns 0x" << static_cast<void*>(retval) << L"\n");
+	return retval;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_WaitOpen(
+	MIDIOut* pMIDIOut, long lTimeout)
+{
+	DEBUG_MESSAGE_W(L"enter " << lTimeout << L"\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		const auto retval{ to_status(port_ptr->wait_open(lTimeout)) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_WaitOpen(
+	MIDIIn* pMIDIIn, long lTimeout)
+{
+	DEBUG_MESSAGE_W(L"enter " << lTimeout << L"\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		const auto retval{ to_status(port_ptr->wait_open(lTimeout)) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIO_OpenPorts(
+	const wchar_t* const* ppszOutNames, long lOutCount,
+	MIDIOut** ppMIDIOut, long* plOutStatus,
+	const wchar_t* const* ppszInNames, long lInCount,
+	MIDIIn** ppMIDIIn, long* plInStatus, long lTimeout)
+{
+	DEBUG_MESSAGE_W(L"enter " << lOutCount << L", " << lInCount
+		<< L", " << lTimeout << L"\n");
+
+	if (lOutCount < 0 || lInCount < 0 ||
+		(lOutCount && (!ppszOutNames || !ppMIDIOut)) ||
+		(lInCount && (!ppszInNames || !ppMIDIIn)))
+	{
+		WARNING_MESSAGE_W(L"invalid argument\n");
+		return 0;
+	}
+
+	const auto deadline{ lTimeout < 0 ?
+		uwp_midiio::midi_clock::time_point::max() :
+		uwp_midiio::midi_clock::now() +
+		std::chrono::milliseconds(lTimeout) };
+
+	std::vector<std::wstring_view> out_names;
+	std::vector<uwp_midiio::open_state> out_states;
+	std::vector<std::wstring_view> in_names;
+	std::vector<uwp_midiio::open_state> in_states;
+	try
+	{
+		for (long i = 0; i < lOutCount; ++i)
+		{
+			out_names.emplace_back(ppszOutNames[i] ?
+				ppszOutNames[i] : L"");
+		}
+		for (long i = 0; i < lInCount; ++i)
+		{
+			in_names.emplace_back(ppszInNames[i] ?
+				ppszInNames[i] : L"");
+		}
+		out_states.resize(out_names.size());
+		in_states.resize(in_names.size());
+	}
+	catch (std::bad_alloc&)
+	{
+		WARNING_MESSAGE_W(L"bad_alloc\n");
+		return 0;
+	}
+
+	const auto retval{ static_cast<long>(
+		uwp_midiio::uwp_midiio_ports::open_ports(
+			out_names.data(), out_names.size(), ppMIDIOut,
+			out_states.data(),
+			in_names.data(), in_names.size(), ppMIDIIn,
+			in_states.data(), deadline)) };
+
+	if (plOutStatus)
+	{
+		for (long i = 0; i < lOutCount; ++i)
+			plOutStatus[i] = to_status(out_states[i]);
+	}
+	if (plInStatus)
+	{
+		for (long i = 0; i < lInCount; ++i)
+			plInStatus[i] = to_status(in_states[i]);
+	}
+
+	DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+	return retval;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetReconnect(
+	MIDIOut* pMIDIOut, long lPolicy)
+{
+	DEBUG_MESSAGE_W(L"enter " << lPolicy << L"\n");
+
+	if (lPolicy != MIDIIO_RECONNECT_OFF &&
+		lPolicy != MIDIIO_RECONNECT_DROP &&
+		lPolicy != MIDIIO_RECONNECT_REPLAY)
+	{
+		WARNING_MESSAGE_W(L"unknown policy\n");
+		return 0;
+	}
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		if (lPolicy != MIDIIO_RECONNECT_OFF)
+		{
+			port_ptr->set_buffer_while_connecting(
+				lPolicy == MIDIIO_RECONNECT_REPLAY);
+		}
+		const auto retval{ static_cast<long>(
+			port_ptr->set_reconnect(lPolicy != MIDIIO_RECONNECT_OFF)) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_SetReconnect(
+	MIDIIn* pMIDIIn, long bEnable)
+{
+	DEBUG_MESSAGE_W(L"enter " << bEnable << L"\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		const auto retval{ static_cast<long>(
+			port_ptr->set_reconnect(bEnable != 0)) };
+
+		DEBUG_MESSAGE_W(L"returns " << retval << L"\n");
+		return retval;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+template<class Port_T>
+static void get_reconnect_stats(const Port_T& port,
+	long long* pReconnects, long long* pLastTime)
+{
+	if (pReconnects)
+		*pReconnects = static_cast<long long>(port.reconnects());
+	if (pLastTime)
+	{
+		*pLastTime = std::chrono::duration_cast<std::chrono::microseconds>(
+			port.last_reconnect_time()).count();
+	}
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetReconnectStats(
+	MIDIOut* pMIDIOut, long long* pReconnects, long long* pLastTime,
+	long long* pLostMessages)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_out(pMIDIOut) };
+	if (port_ptr)
+	{
+		get_reconnect_stats(*port_ptr.get(), pReconnects, pLastTime);
+		if (pLostMessages)
+			*pLostMessages =
+				static_cast<long long>(port_ptr->lost_messages());
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
+
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetReconnectStats(
+	MIDIIn* pMIDIIn, long long* pReconnects, long long* pLastTime)
+{
+	DEBUG_MESSAGE_W(L"enter\n");
+
+	auto port_ptr{ uwp_midiio::uwp_midiio_ports::find_in(pMIDIIn) };
+	if (port_ptr)
+	{
+		get_reconnect_stats(*port_ptr.get(), pReconnects, pLastTime);
+
+		DEBUG_MESSAGE_W(L"returns 1\n");
+		return 1;
+	}
+
+	WARNING_MESSAGE_W(L"invalid handle\n");
+	return MIDIIO_ERROR_INVALID_HANDLE;
+}
@@ -135,3 +135,422 @@ UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessage(
 #ifdef __cplusplus
 }
 #endif
+
+//
+// UWP MIDIIO extended APIs
+//
+// These are not in MIDIIO.dll.
+//
+// MIDIIn_Close and MIDIOut_Close can be called while other threads
+// are using the same port: calls in progress finish (waiting calls
+// return at once) before the port is destroyed,
+// and later calls get MIDIIO_ERROR_INVALID_HANDLE (0 for the MIDIIO.dll
+// APIs).
+//
+
+// Overflow policies of MIDIIn_OpenExW
+#define MIDIIO_OVERFLOW_DROP_OLDEST 0
+#define MIDIIO_OVERFLOW_DROP_NEWEST 1
+#define MIDIIO_OVERFLOW_KEEP_REALTIME_SYSEX 2
+#define MIDIIO_OVERFLOW_GROW 3
+
+// Lanes of MIDIOut_GetLaneBacklog
+#define MIDIIO_LANE_REALTIME 0
+#define MIDIIO_LANE_VOICE 1
+#define MIDIIO_LANE_SYSEX 2
+
+// Error codes (negative return values) of the extended APIs
+// and of the MIDIIO.dll APIs in the modes enabled by them
+#define MIDIIO_ERROR_QUEUE_FULL (-1)
+// The handle is not an open port (never opened or already closed).
+// The MIDIIO.dll APIs return 0 for such handles instead.
+#define MIDIIO_ERROR_INVALID_HANDLE (-2)
+// The port opened by MIDIOut_OpenAsyncW is still connecting
+// and does not buffer output.
+#define MIDIIO_ERROR_NOT_CONNECTED (-3)
+// Overflow has dropped the rest of the message being read
+// by MIDIIn_GetMIDIMessagePartial.
+#define MIDIIO_ERROR_MESSAGE_DROPPED (-4)
+
+// States of ports opened by MIDIOut_OpenAsyncW and MIDIIn_OpenAsyncW
+#define MIDIIO_STATUS_CONNECTING 0
+#define MIDIIO_STATUS_OPEN 1
+#define MIDIIO_STATUS_FAILED 2
+// Only returned by MIDIOut_WaitOpen and MIDIIn_WaitOpen
+// when another thread closes the port
+#define MIDIIO_STATUS_CLOSED 3
+
+// Flags of MIDIOut_OpenAsyncW
+// Buffers output while connecting instead of rejecting it.
+#define MIDIIO_OPEN_BUFFER 1
+
+// Callback of MIDIIn_SetCallback
+// `lCount` messages are stored back to back in `pBuffer`,
+// with the length and the timestamp of each one
+// in `pLengths` and `pTimestamps`.
+// The arrays are valid only during the call.
+typedef void (UWP_MIDIIO_API* MIDIIn_Callback)(MIDIIn* pMIDIIn,
+	const unsigned char* pBuffer, const long* pLengths,
+	const long long* pTimestamps, long lCount, void* pUser);
+
+// Reconnection policies of MIDIOut_SetReconnect
+#define MIDIIO_RECONNECT_OFF 0
+// Output while disconnected is rejected (MIDIIO_ERROR_NOT_CONNECTED).
+#define MIDIIO_RECONNECT_DROP 1
+// Output while disconnected is buffered and sent after reconnecting.
+#define MIDIIO_RECONNECT_REPLAY 2
+
+// Callback of MIDIOut_OpenAsyncW and MIDIIn_OpenAsyncW
+// `lStatus` is MIDIIO_STATUS_OPEN or MIDIIO_STATUS_FAILED.
+typedef void (UWP_MIDIIO_API* MIDIIO_OpenCallback)(MIDIIO_Port* pPort,
+	long lStatus, void* pUser);
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Returns the current time in microseconds on the monotonic clock
+// (QueryPerformanceCounter) used for the timestamps of this library.
+UWP_MIDIIO_DECLSPEC long long UWP_MIDIIO_API MIDIIO_GetTime();
+
+// Same as MIDIIn_OpenW but specifies what happens when the receive queue
+// is full.
+//   MIDIIO_OVERFLOW_DROP_OLDEST (default of MIDIIn_OpenW):
+//     the oldest messages are dropped.
+//   MIDIIO_OVERFLOW_DROP_NEWEST:
+//     arriving messages are dropped.
+//   MIDIIO_OVERFLOW_KEEP_REALTIME_SYSEX:
+//     arriving messages are dropped except realtime and SysEx messages.
+//   MIDIIO_OVERFLOW_GROW:
+//     the queue starts small and grows up to `lQueueSize` messages,
+//     then arriving messages are dropped.
+// `lQueueSize` is the number of messages (0 for the default).
+UWP_MIDIIO_DECLSPEC MIDIIn* UWP_MIDIIO_API MIDIIn_OpenExW(
+	const wchar_t* pszDeviceName, long lOverflowPolicy, long lQueueSize);
+
+// Stores the number of messages and bytes dropped by queue overflow
+// since the port was opened.
+// Either pointer can be NULL.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetDroppedCount(
+	MIDIIn* pMIDIIn, long long* pMessages, long long* pBytes);
+
+// Same as MIDIIn_GetMIDIMessage but also stores the time when the device
+// received the message to `pTimestamp` (see MIDIIO_GetTime).
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessageEx(
+	MIDIIn* pMIDIIn, unsigned char* pMessage, long lLen,
+	long long* pTimestamp);
+
+// Receives as many whole messages as fit in `pBuffer` (`lLen` bytes),
+// up to `lMaxCount` messages, in one call.
+// The messages are stored back to back and the length of each one is
+// stored in `pLengths` (`lMaxCount` elements).
+// If `pTimestamps` is not NULL, the timestamp of each one is stored in it
+// (`lMaxCount` elements, see MIDIIn_GetMIDIMessageEx).
+// If the first message alone does not fit, it is truncated
+// in the same way as MIDIIn_GetMIDIMessage.
+// Returns the number of messages received (0 if there is none).
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessages(
+	MIDIIn* pMIDIIn, unsigned char* pBuffer, long lLen,
+	long* pLengths, long long* pTimestamps, long lMaxCount);
+
+// Receives a message in pieces without truncating it.
+// Copies up to `lLen` bytes of the next message, continuing from where
+// the previous call stopped, and stores the number of bytes still unread
+// to `plRemaining` (0 when the whole message has been read).
+// The message stays in the queue until all of it has been read.
+// If another receive function is called in between, it receives
+// the unread rest as the next message.
+// If `pTimestamp` is not NULL, the timestamp is stored in it
+// (see MIDIIn_GetMIDIMessageEx).
+// Returns the number of bytes copied (0 if there is no message),
+// MIDIIO_ERROR_MESSAGE_DROPPED if overflow has dropped the message
+// being read (the dropped counter includes it; the next call starts
+// the next message).
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetMIDIMessagePartial(
+	MIDIIn* pMIDIIn, unsigned char* pMessage, long lLen,
+	long* plRemaining, long long* pTimestamp);
+
+// Returns the unread length of the next message without removing it
+// (0 if there is no message).
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_PeekMIDIMessageLength(
+	MIDIIn* pMIDIIn);
+
+// Waits until a message arrives at `pMIDIIn`
+// or `lTimeout` milliseconds elapse (negative means infinite)
+// without polling.
+// Returns 1 if a message can be received, 0 on timeout.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_WaitMIDIMessage(
+	MIDIIn* pMIDIIn, long lTimeout);
+
+// Same as MIDIIn_WaitMIDIMessage but waits on `lCount` ports at once.
+// Returns the index in `ppMIDIIn` of a port that has a message,
+// -1 on timeout.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_WaitMIDIMessageMulti(
+	MIDIIn** ppMIDIIn, long lCount, long lTimeout);
+
+// Delivers received messages to `pCallback` in batches
+// instead of queuing them for MIDIIn_GetMIDIMessage etc.
+// It is called on a dedicated thread of the port (one at a time),
+// never on the thread that receives from the device.
+// While a callback is set, the receive and wait functions
+// return no message for the port.
+// NULL removes the callback and goes back to polling.
+// Must not be called from the callback itself,
+// nor concurrently with the receive functions for the same port.
+// MIDIIn_Close removes the callback and waits for it to return.
+// The callback may close its own port, but must not use
+// the handle after MIDIIn_Close returns.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_SetCallback(
+	MIDIIn* pMIDIIn, MIDIIn_Callback pCallback, void* pUser);
+
+// Switches `pMIDIOut` to asynchronous mode:
+// MIDIOut_PutMIDIMessage queues the message and returns at once,
+// and a sender thread of the port sends queued messages in order.
+// If the queue is full, MIDIOut_PutMIDIMessage returns
+// MIDIIO_ERROR_QUEUE_FULL without blocking or queuing the message.
+// A buffer with several messages (running status and SysEx split over
+// several calls are allowed) is queued message by message;
+// if the queue becomes full partway, the return value is the number of
+// bytes queued and the rest can be put again later.
+// A long SysEx is queued in pieces of 16 KiB, so it can be put
+// in this way whatever its length.
+// `lQueueSize` is the number of messages (0 for the default).
+// `bEnable` = 0 goes back to synchronous mode
+// after the queued messages have been sent.
+// MIDIOut_PutMIDIMessage must not be called for the same port
+// from several threads at once, nor concurrently with this function.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetAsync(
+	MIDIOut* pMIDIOut, long bEnable, long lQueueSize);
+
+// Same as MIDIOut_PutMIDIMessage in asynchronous mode but the message is
+// sent at `llTime` (see MIDIIO_GetTime) instead of at once.
+// A time in the past means at once.
+// Messages with the same time are sent in the order they were put.
+// Hosts can put messages ahead of time so that the send timing does not
+// depend on the timing of the calls.
+// Returns `lLen` on success (or the number of bytes queued, see
+// MIDIOut_SetAsync), MIDIIO_ERROR_QUEUE_FULL if the queue is full,
+// 0 on failure (including synchronous mode).
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_PutMIDIMessageAt(
+	MIDIOut* pMIDI, unsigned char* pMessage, long lLen, long long llTime);
+
+// The sender thread of `pMIDIOut` sleeps until `lMargin` microseconds
+// before the time of a scheduled message and then spins until the time.
+// A smaller margin uses less CPU, but the system timer (about 1 ms)
+// may wake it up late. 0 disables spinning.
+// The default is 1000.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetScheduleSpin(
+	MIDIOut* pMIDIOut, long lMargin);
+
+// Waits until all queued messages of `pMIDIOut` have been sent
+// or `lTimeout` milliseconds elapse (negative means infinite).
+// Returns 1 if the queue is empty, 0 on timeout or failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_Flush(
+	MIDIOut* pMIDIOut, long lTimeout);
+
+// Returns the number of messages queued but not sent yet,
+// including the ones scheduled by MIDIOut_PutMIDIMessageAt
+// (always 0 in synchronous mode).
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetQueueDepth(
+	MIDIOut* pMIDIOut);
+
+// In asynchronous mode (see MIDIOut_SetAsync), packs short messages
+// queued within `lWindow` microseconds after the first one
+// into one device write, so that a BLE link sends them in one packet.
+// If `bRunningStatus` is not 0, a status byte equal to the previous one
+// in the same write is omitted.
+// Realtime messages are sent at once, ahead of the packed messages.
+// SysEx and system common messages are sent alone.
+// `lWindow` = 0 disables it (default).
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetPacking(
+	MIDIOut* pMIDIOut, long lWindow, long bRunningStatus);
+
+// In asynchronous mode, limits the output of `pMIDIOut` to
+// `lBytesPerSecond` so that a slow link (e.g. BLE) is not saturated.
+// While limited, messages wait in three lanes: realtime messages
+// (0xF8-0xFF) are sent first, then channel and system common messages,
+// then SysEx. The order within a lane is kept.
+// 0 removes the limit (default).
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetRateLimit(
+	MIDIOut* pMIDIOut, long lBytesPerSecond);
+
+// Stores the number of messages and bytes waiting in lane `lLane`
+// (MIDIIO_LANE_*) for the rate limiter. Either pointer can be NULL.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetLaneBacklog(
+	MIDIOut* pMIDIOut, long lLane, long long* pMessages, long long* pBytes);
+
+// In asynchronous mode, sends SysEx messages longer than `lChunkSize`
+// bytes in chunks of `lChunkSize` bytes, at least `lInterval`
+// microseconds apart, for devices that drop or corrupt long writes.
+// Realtime messages are sent between the chunks. Other messages wait
+// until the SysEx is complete, since they would terminate it.
+// `lChunkSize` = 0 disables it (default).
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetSysExChunking(
+	MIDIOut* pMIDIOut, long lChunkSize, long lInterval);
+
+// Stores the number of bytes already sent and the length of
+// the SysEx message being sent in chunks (or the last one).
+// Either pointer can be NULL.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetSysExProgress(
+	MIDIOut* pMIDIOut, long long* pSent, long long* pTotal);
+
+// Puts the same message to the `lCount` ports in `ppMIDIOut`
+// (NULL entries are skipped).
+// The message is queued to the ports in asynchronous mode first,
+// so that their sender threads send it at about the same time,
+// then one buffer is sent to the ports in synchronous mode.
+// The same restrictions as MIDIOut_PutMIDIMessage apply to each port.
+// If `pResults` is not NULL, stores what MIDIOut_PutMIDIMessage would
+// return for each port to its `lCount` entries. A port in asynchronous
+// mode may have queued a part of the message when the queue became full;
+// the rest can be put to it by MIDIOut_PutMIDIMessage.
+// Returns the number of ports that took the whole message.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_PutMIDIMessageMulti(
+	MIDIOut** ppMIDIOut, long lCount, unsigned char* pMessage, long lLen,
+	long* pResults);
+
+// Drops control change, program change, channel pressure and pitch bend
+// messages of `pMIDIOut` that repeat the value sent for the same channel
+// (and controller) less than `lWindow` microseconds ago.
+// Notes, SysEx and other messages are always sent, bank select,
+// data entry, RPN/NRPN and channel mode messages too.
+// Bank select, reset all controllers, SysEx and system reset make the
+// next values be sent again.
+// Only whole single messages are checked in synchronous mode.
+// 0 disables it (default).
+// If `pSavedBytes` is not NULL, the number of bytes dropped so far
+// is stored in it.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetDuplicateFilter(
+	MIDIOut* pMIDIOut, long lWindow, long long* pSavedBytes);
+
+// Enables coalescing when the application cannot keep up:
+// once `lThreshold` messages are queued, an arriving control change,
+// pitch bend or channel pressure message overwrites the queued one
+// of the same channel and controller instead of being appended.
+// Bank select, data entry, switches (64-69), RPN/NRPN and channel mode
+// messages are never coalesced.
+// The timestamp of the queued message is updated too, but a message read
+// while it is being overwritten may carry the timestamp of the value
+// it replaced (one update behind).
+// 0 disables it (default).
+// If `pCoalesced` is not NULL, the number of messages coalesced so far
+// is stored in it.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_SetCoalescing(
+	MIDIIn* pMIDIIn, long lThreshold, long long* pCoalesced);
+
+// Same as MIDIOut_OpenW but returns at once without waiting for
+// the device (BLE devices can take seconds to connect).
+// The port is in MIDIIO_STATUS_CONNECTING until it has been opened
+// or has failed, then `pCallback` (if not NULL) is called
+// on a thread of the library with the handle and the status.
+// The handle is valid until MIDIOut_Close even if opening fails.
+// While connecting, MIDIOut_PutMIDIMessage returns
+// MIDIIO_ERROR_NOT_CONNECTED, or with MIDIIO_OPEN_BUFFER in `lFlags`,
+// buffers the message (up to 64 KiB in synchronous mode,
+// MIDIIO_ERROR_QUEUE_FULL beyond; the send queue in asynchronous mode)
+// and sends it when connected.
+// MIDIOut_Close waits for the connection attempt to finish,
+// and the callback is not called after it.
+// The callback must not close the port.
+// Returns NULL on failure.
+UWP_MIDIIO_DECLSPEC MIDIOut* UWP_MIDIIO_API MIDIOut_OpenAsyncW(
+	const wchar_t* pszDeviceName, long lFlags,
+	MIDIIO_OpenCallback pCallback, void* pUser);
+
+// Same as MIDIIn_OpenExW but returns at once
+// (see MIDIOut_OpenAsyncW). No message arrives while connecting.
+UWP_MIDIIO_DECLSPEC MIDIIn* UWP_MIDIIO_API MIDIIn_OpenAsyncW(
+	const wchar_t* pszDeviceName, long lOverflowPolicy, long lQueueSize,
+	MIDIIO_OpenCallback pCallback, void* pUser);
+
+// Waits while the port is connecting
+// or until `lTimeout` milliseconds elapse (negative means infinite).
+// Ports opened by the other open functions are always open.
+// Closing the port from another thread wakes it up.
+// Returns MIDIIO_STATUS_* (MIDIIO_STATUS_CLOSED if the port has been
+// closed meanwhile), MIDIIO_ERROR_INVALID_HANDLE for an invalid
+// handle.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_WaitOpen(
+	MIDIOut* pMIDIOut, long lTimeout);
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_WaitOpen(
+	MIDIIn* pMIDIIn, long lTimeout);
+
+// Opens `lOutCount` MIDI OUT ports and `lInCount` MIDI IN ports
+// named by `ppszOutNames` and `ppszInNames` at once
+// and waits for them until `lTimeout` milliseconds elapse
+// (negative means infinite), so that it takes as long as
+// the slowest port instead of the sum.
+// The handle of each port is stored to `ppMIDIOut` / `ppMIDIIn`
+// (NULL if it has failed) and the status (MIDIIO_STATUS_*) to
+// `plOutStatus` / `plInStatus` (can be NULL).
+// Ports still connecting at the timeout keep their handles
+// (see MIDIOut_OpenAsyncW, without MIDIIO_OPEN_BUFFER)
+// and must be closed even if they fail later.
+// MIDI IN ports are opened in the same way as MIDIIn_OpenW.
+// Returns the number of ports opened.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIO_OpenPorts(
+	const wchar_t* const* ppszOutNames, long lOutCount,
+	MIDIOut** ppMIDIOut, long* plOutStatus,
+	const wchar_t* const* ppszInNames, long lInCount,
+	MIDIIn** ppMIDIIn, long* plInStatus, long lTimeout);
+
+// Keeps `pMIDIOut` usable when its device (e.g. BLE) disconnects:
+// the port is opened again by the same device in the background
+// when it comes back, and the handle stays valid.
+// While disconnected, the status is MIDIIO_STATUS_CONNECTING
+// (see MIDIOut_WaitOpen) and output is handled by `lPolicy`:
+//   MIDIIO_RECONNECT_DROP:
+//     MIDIOut_PutMIDIMessage returns MIDIIO_ERROR_NOT_CONNECTED.
+//   MIDIIO_RECONNECT_REPLAY:
+//     the same as MIDIOut_OpenAsyncW with MIDIIO_OPEN_BUFFER.
+// In asynchronous mode, messages queued before the disconnection
+// are sent after reconnecting with either policy.
+// The policy also applies to a port opened by MIDIOut_OpenAsyncW
+// that is still connecting.
+// MIDIIO_RECONNECT_OFF disables it (default). If the port is
+// disconnected then, the status becomes MIDIIO_STATUS_FAILED.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_SetReconnect(
+	MIDIOut* pMIDIOut, long lPolicy);
+
+// Same as MIDIOut_SetReconnect for MIDI IN.
+// Messages sent by the device while disconnected are lost.
+// `bEnable` = 0 disables it (default).
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_SetReconnect(
+	MIDIIn* pMIDIIn, long bEnable);
+
+// Stores the number of reconnections, the time in microseconds from
+// the last disconnection to the reconnection, and the number of
+// MIDIOut_PutMIDIMessage calls whose messages were not sent
+// because the port was not connected (rejected, or the buffer was full).
+// Any pointer can be NULL.
+// Returns 1 on success, 0 on failure.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIOut_GetReconnectStats(
+	MIDIOut* pMIDIOut, long long* pReconnects, long long* pLastTime,
+	long long* pLostMessages);
+
+// Same as MIDIOut_GetReconnectStats for MIDI IN
+// without the lost messages: what the device sends while disconnected
+// never reaches the host, and MIDI (including BLE MIDI) has no
+// sequence numbers that would tell how much it was.
+// Messages dropped after they were received are counted by
+// MIDIIn_GetDroppedCount instead.
+UWP_MIDIIO_DECLSPEC long UWP_MIDIIO_API MIDIIn_GetReconnectStats(
+	MIDIIn* pMIDIIn, long long* pReconnects, long long* pLastTime);
+
+#ifdef __cplusplus
+}
+#endif
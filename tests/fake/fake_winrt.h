@@ -0,0 +1,524 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// fake_winrt.h:
+//   Fake WinRT/Win32 backend for the Linux tests
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+// Only the parts of C++/WinRT and Win32 that the library uses.
+// Tests add devices, feed MIDI IN messages and watch MIDI OUT sends
+// through the functions in namespace fake_winrt.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cwchar>
+#include <initializer_list>
+#include <new>
+
+// Win32
+#define __declspec(x)
+#define __stdcall
+#define APIENTRY
+typedef int BOOL;
+typedef unsigned long DWORD;
+typedef unsigned int UINT;
+typedef void* LPVOID;
+typedef void* HMODULE;
+#define TRUE 1
+#define DLL_PROCESS_ATTACH 1
+#define DLL_THREAD_ATTACH 2
+#define DLL_THREAD_DETACH 3
+#define DLL_PROCESS_DETACH 0
+#define TIMERR_NOERROR 0
+
+inline void OutputDebugStringA(const char*) {}
+inline void OutputDebugStringW(const wchar_t*) {}
+inline int wcsncpy_s(wchar_t* dest, long, const wchar_t* src, size_t count)
+{
+	std::wcsncpy(dest, src, count);
+	dest[count] = L'\0';
+	return 0;
+}
+inline UINT timeBeginPeriod(UINT) { return TIMERR_NOERROR; }
+inline UINT timeEndPeriod(UINT) { return TIMERR_NOERROR; }
+
+namespace winrt
+{
+	struct hstring
+	{
+		hstring() = default;
+		hstring(const wchar_t* s) : s_(s) {}
+		hstring(std::wstring_view s) : s_(s) {}
+		hstring(std::wstring const& s) : s_(s) {}
+		operator std::wstring_view() const { return s_; }
+		operator std::wstring() const { return s_; }
+
+		std::wstring s_;
+	};
+
+	struct hresult_error
+	{
+		int32_t code() const { return code_; }
+		hstring message() const { return L"fake"; }
+
+		int32_t code_{ 0 };
+	};
+
+	struct event_token
+	{
+		long long value{ 0 };
+		explicit operator bool() const { return value != 0; }
+	};
+
+	template<class T>
+	struct array_view
+	{
+		template<class P>
+		array_view(P first, P last) : first_(first), last_(last) {}
+
+		const T* first_;
+		const T* last_;
+	};
+	template<class T>
+	array_view(T*, T*) -> array_view<T>;
+
+	inline void init_apartment() {}
+}
+
+namespace winrt::Windows::Foundation
+{
+	enum class AsyncStatus { Started, Completed, Canceled, Error };
+	using TimeSpan =
+		std::chrono::duration<long long, std::ratio<1, 10000000>>;
+
+	// Completes before it is returned.
+	template<class T>
+	struct IAsyncOperation
+	{
+		IAsyncOperation(std::nullptr_t = nullptr) {}
+		IAsyncOperation(T result) : result_(std::move(result)) {}
+
+		template<class D>
+		AsyncStatus wait_for(D) const { return AsyncStatus::Completed; }
+		AsyncStatus Status() const { return AsyncStatus::Completed; }
+		T GetResults() const { return result_; }
+		T get() const { return result_; }
+		void Cancel() const {}
+
+		T result_{ nullptr };
+	};
+
+	struct IInspectable
+	{
+		IInspectable(std::nullptr_t = nullptr) {}
+		explicit operator bool() const { return false; }
+	};
+
+	template<class Sender, class Args>
+	struct TypedEventHandler
+	{
+		template<class O, class M>
+		TypedEventHandler(O* object, M method) :
+			f_([object, method](Sender const& s, Args const& a)
+				{ (object->*method)(s, a); })
+		{
+		}
+		template<class F>
+		TypedEventHandler(F f) : f_(std::move(f)) {}
+
+		void operator()(Sender const& s, Args const& a) const { f_(s, a); }
+
+		std::function<void(Sender const&, Args const&)> f_;
+	};
+}
+
+namespace winrt::Windows::Foundation::Collections
+{
+	template<class T>
+	struct IVectorView
+	{
+		IVectorView(std::nullptr_t = nullptr) {}
+		IVectorView(std::vector<T> v) : v_(std::move(v)) {}
+		auto begin() const { return v_.begin(); }
+		auto end() const { return v_.end(); }
+
+		std::vector<T> v_;
+	};
+}
+
+namespace winrt
+{
+	template<class T>
+	T unbox_value_or(Windows::Foundation::IInspectable const&, T v)
+	{
+		return v;
+	}
+}
+
+namespace winrt::Windows::Storage::Streams
+{
+	struct IBuffer
+	{
+		IBuffer(std::nullptr_t = nullptr) {}
+
+		unsigned char* data() const { return v_ ? v_->data() : nullptr; }
+		uint32_t Length() const { return *length_; }
+		void Length(uint32_t len) const { *length_ = len; }
+		uint32_t Capacity() const
+		{
+			return v_ ? static_cast<uint32_t>(v_->size()) : 0;
+		}
+		explicit operator bool() const { return static_cast<bool>(v_); }
+
+		std::shared_ptr<std::vector<unsigned char>> v_;
+		std::shared_ptr<uint32_t> length_{ std::make_shared<uint32_t>(0) };
+	};
+
+	struct Buffer : IBuffer
+	{
+		Buffer(std::nullptr_t) {}
+		explicit Buffer(uint32_t capacity)
+		{
+			v_ = std::make_shared<std::vector<unsigned char>>(capacity);
+		}
+	};
+}
+
+namespace winrt::Windows::Security::Cryptography
+{
+	struct CryptographicBuffer
+	{
+		static Storage::Streams::IBuffer CreateFromByteArray(
+			array_view<const unsigned char> a)
+		{
+			Storage::Streams::Buffer b(
+				static_cast<uint32_t>(a.last_ - a.first_));
+			std::copy(a.first_, a.last_, b.data());
+			b.Length(b.Capacity());
+			return b;
+		}
+	};
+}
+
+namespace winrt::Windows::Devices::Enumeration
+{
+	struct PropertyMap
+	{
+		Foundation::IInspectable TryLookup(hstring) const { return {}; }
+	};
+
+	struct DeviceInformationUpdate
+	{
+		hstring Id() const { return {}; }
+		PropertyMap Properties() const { return {}; }
+	};
+
+	enum class DeviceWatcherStatus
+	{
+		Created, Started, EnumerationCompleted, Stopping, Stopped, Aborted
+	};
+
+	struct DeviceInformation;
+
+	// Never reports anything
+	struct DeviceWatcher
+	{
+		DeviceWatcher(std::nullptr_t = nullptr) {}
+		template<class H>
+		event_token Added(H) const { return {}; }
+		template<class H>
+		event_token Updated(H) const { return {}; }
+		template<class H>
+		event_token Removed(H) const { return {}; }
+		void Start() const {}
+		void Stop() const {}
+		DeviceWatcherStatus Status() const
+		{
+			return DeviceWatcherStatus::Stopped;
+		}
+	};
+
+	struct DeviceInformation
+	{
+		DeviceInformation(std::nullptr_t = nullptr) {}
+		DeviceInformation(std::wstring name, std::wstring id) :
+			name_(std::move(name)), id_(std::move(id))
+		{
+		}
+
+		hstring Name() const { return name_; }
+		hstring Id() const { return id_; }
+		PropertyMap Properties() const { return {}; }
+
+		static Foundation::IAsyncOperation<
+			Foundation::Collections::IVectorView<DeviceInformation>>
+			FindAllAsync(hstring selector);
+		static DeviceWatcher CreateWatcher(hstring,
+			std::initializer_list<hstring>)
+		{
+			return {};
+		}
+
+		std::wstring name_;
+		std::wstring id_;
+	};
+}
+
+namespace winrt::Windows::Devices::Midi
+{
+	enum class MidiMessageType { None };
+
+	struct IMidiMessage
+	{
+		IMidiMessage(std::nullptr_t = nullptr) {}
+
+		Storage::Streams::IBuffer RawData() const { return raw_data_; }
+		Foundation::TimeSpan Timestamp() const { return timestamp_; }
+		MidiMessageType Type() const { return MidiMessageType::None; }
+
+		Storage::Streams::IBuffer raw_data_;
+		Foundation::TimeSpan timestamp_{ 0 };
+	};
+
+	struct MidiMessageReceivedEventArgs
+	{
+		IMidiMessage Message() const { return message_; }
+
+		IMidiMessage message_;
+	};
+
+	struct MidiInPort;
+	using MessageReceivedHandler =
+		Foundation::TypedEventHandler<MidiInPort,
+		MidiMessageReceivedEventArgs>;
+
+	// Shared by all MidiInPort objects of a device
+	struct fake_in_device
+	{
+		std::mutex mtx;
+		std::map<long long, MessageReceivedHandler> handlers;
+		long long next_token{ 1 };
+	};
+
+	struct MidiInPort
+	{
+		MidiInPort(std::nullptr_t = nullptr) {}
+		explicit operator bool() const { return static_cast<bool>(device_); }
+
+		event_token MessageReceived(MessageReceivedHandler h) const
+		{
+			std::lock_guard<std::mutex> lock(device_->mtx);
+			const auto token{ device_->next_token++ };
+			device_->handlers.emplace(token, std::move(h));
+			return { token };
+		}
+		void MessageReceived(event_token token) const
+		{
+			std::lock_guard<std::mutex> lock(device_->mtx);
+			device_->handlers.erase(token.value);
+		}
+		void Close() const {}
+		hstring DeviceId() const { return id_; }
+
+		static Foundation::IAsyncOperation<MidiInPort> FromIdAsync(
+			hstring id);
+		static hstring GetDeviceSelector() { return L"in"; }
+
+		std::shared_ptr<fake_in_device> device_;
+		std::wstring id_;
+	};
+
+	struct IMidiOutPort
+	{
+		IMidiOutPort(std::nullptr_t = nullptr) {}
+		explicit operator bool() const { return !id_.empty(); }
+
+		void SendBuffer(Storage::Streams::IBuffer const& b) const;
+		void SendMessage(IMidiMessage const&) const {}
+		void Close() const {}
+		hstring DeviceId() const { return id_; }
+
+		std::wstring id_;
+	};
+
+	struct MidiOutPort
+	{
+		static Foundation::IAsyncOperation<IMidiOutPort> FromIdAsync(
+			hstring id);
+		static hstring GetDeviceSelector() { return L"out"; }
+	};
+}
+
+namespace fake_winrt
+{
+	using winrt::Windows::Devices::Enumeration::DeviceInformation;
+	using winrt::Windows::Devices::Midi::fake_in_device;
+
+	struct state
+	{
+		std::mutex mtx;
+		std::vector<DeviceInformation> in_devices;
+		std::vector<DeviceInformation> out_devices;
+		std::map<std::wstring, std::shared_ptr<fake_in_device>,
+			std::less<>> in_ports;
+		std::function<void(std::wstring_view, const unsigned char*,
+			uint32_t)> on_send;
+		std::atomic<int> open_delay_ms{ 0 };
+	};
+
+	inline state& get()
+	{
+		static state s;
+		return s;
+	}
+
+	// Plain IDs (without "#MIDII_") make the display name the same
+	// as `name`.
+	inline void add_in_device(std::wstring name, std::wstring id)
+	{
+		auto& s{ get() };
+		std::lock_guard<std::mutex> lock(s.mtx);
+		s.in_devices.emplace_back(std::move(name), id);
+		s.in_ports.emplace(std::move(id),
+			std::make_shared<fake_in_device>());
+	}
+	inline void add_out_device(std::wstring name, std::wstring id)
+	{
+		auto& s{ get() };
+		std::lock_guard<std::mutex> lock(s.mtx);
+		s.out_devices.emplace_back(std::move(name), std::move(id));
+	}
+
+	// Delivers a message to every MessageReceived handler of the device
+	inline void receive(std::wstring_view id,
+		std::vector<unsigned char> bytes)
+	{
+		using namespace winrt::Windows::Devices::Midi;
+
+		std::shared_ptr<fake_in_device> device;
+		{
+			auto& s{ get() };
+			std::lock_guard<std::mutex> lock(s.mtx);
+			const auto it{ s.in_ports.find(id) };
+			if (it == s.in_ports.end())
+				return;
+			device = it->second;
+		}
+
+		MidiMessageReceivedEventArgs args;
+		winrt::Windows::Storage::Streams::Buffer b(
+			static_cast<uint32_t>(bytes.size()));
+		std::copy(bytes.begin(), bytes.end(), b.data());
+		b.Length(b.Capacity());
+		args.message_.raw_data_ = b;
+
+		MidiInPort sender;
+		sender.device_ = device;
+		std::lock_guard<std::mutex> lock(device->mtx);
+		for (const auto& h : device->handlers)
+			h.second(sender, args);
+	}
+
+	inline void set_on_send(std::function<void(std::wstring_view,
+		const unsigned char*, uint32_t)> f)
+	{
+		auto& s{ get() };
+		std::lock_guard<std::mutex> lock(s.mtx);
+		s.on_send = std::move(f);
+	}
+
+	inline void delay_open()
+	{
+		const auto ms{ get().open_delay_ms.load() };
+		if (ms)
+			std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	}
+}
+
+namespace winrt::Windows::Devices::Enumeration
+{
+	inline Foundation::IAsyncOperation<
+		Foundation::Collections::IVectorView<DeviceInformation>>
+		DeviceInformation::FindAllAsync(hstring selector)
+	{
+		auto& s{ fake_winrt::get() };
+		std::lock_guard<std::mutex> lock(s.mtx);
+		return Foundation::Collections::IVectorView<DeviceInformation>(
+			std::wstring_view{ selector } == L"in" ?
+			s.in_devices : s.out_devices);
+	}
+}
+
+namespace winrt::Windows::Devices::Midi
+{
+	inline Foundation::IAsyncOperation<MidiInPort> MidiInPort::FromIdAsync(
+		hstring id)
+	{
+		fake_winrt::delay_open();
+
+		auto& s{ fake_winrt::get() };
+		std::lock_guard<std::mutex> lock(s.mtx);
+		const auto it{ s.in_ports.find(std::wstring_view{ id }) };
+		if (it == s.in_ports.end())
+			return MidiInPort{ nullptr };
+
+		MidiInPort p;
+		p.device_ = it->second;
+		p.id_ = id;
+		return p;
+	}
+
+	inline Foundation::IAsyncOperation<IMidiOutPort>
+		MidiOutPort::FromIdAsync(hstring id)
+	{
+		fake_winrt::delay_open();
+
+		IMidiOutPort p;
+		p.id_ = id;
+		return p;
+	}
+
+	inline void IMidiOutPort::SendBuffer(
+		Storage::Streams::IBuffer const& b) const
+	{
+		std::function<void(std::wstring_view, const unsigned char*,
+			uint32_t)> f;
+		{
+			auto& s{ fake_winrt::get() };
+			std::lock_guard<std::mutex> lock(s.mtx);
+			f = s.on_send;
+		}
+		if (f)
+			f(id_, b.data(), b.Length());
+	}
+}
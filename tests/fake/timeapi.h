@@ -0,0 +1,2 @@
+// Fake for the Linux tests: timeBeginPeriod() etc. are in fake_winrt.h
+#pragma once
@@ -0,0 +1,286 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_message_queue_test.cpp:
+//   Tests of midi_message_queue with a synthetic producer
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "midi_message_queue.h"
+
+#include "test.h"
+
+using namespace uwp_midiio;
+using policy = midi_message_queue::overflow_policy;
+
+namespace
+{
+	// Message `n` is a note on (short) or a SysEx (long)
+	// that carries `n` in its data bytes.
+	std::vector<unsigned char> make_message(int n, bool sysex)
+	{
+		if (!sysex)
+			return { 0x90, static_cast<unsigned char>(n & 0x7f),
+				static_cast<unsigned char>((n >> 7) & 0x7f) };
+
+		std::vector<unsigned char> m{ 0xf0 };
+		for (int i = 0; i < 4; ++i)
+			m.push_back(static_cast<unsigned char>((n >> (i * 7)) & 0x7f));
+		m.resize(8 + n % 64, 0x55);
+		m.push_back(0xf7);
+		return m;
+	}
+
+	int message_number(const unsigned char* data, size_t len)
+	{
+		if (data[0] == 0x90)
+		{
+			CHECK(len == 3);
+			return data[1] | (data[2] << 7);
+		}
+
+		CHECK(data[0] == 0xf0 && data[len - 1] == 0xf7 && len >= 9);
+		int n{ 0 };
+		for (int i = 0; i < 4; ++i)
+			n |= data[1 + i] << (i * 7);
+		CHECK(len == static_cast<size_t>(9 + n % 64));
+		return n;
+	}
+
+	bool push(midi_message_queue& q, int n, bool sysex = false)
+	{
+		const auto m{ make_message(n, sysex) };
+		return q.push(m.data(), m.size(), n);
+	}
+
+	std::vector<int> pop_all(midi_message_queue& q)
+	{
+		std::vector<int> numbers;
+		q.consume(std::numeric_limits<size_t>::max(),
+			[&](const unsigned char* data, size_t len, long long timestamp)
+		{
+			const auto n{ message_number(data, len) };
+			CHECK(n == timestamp);
+			numbers.push_back(n);
+			return true;
+		});
+		return numbers;
+	}
+
+	// The producer pushes `count` messages while the consumer reads.
+	// Every received message must be newer than the previous one,
+	// and all of them must be received unless dropped.
+	void synthetic_producer(policy p, size_t limit, size_t arena_size,
+		int count, std::chrono::microseconds consumer_pause)
+	{
+		midi_message_queue q(limit, arena_size, p);
+		std::atomic<bool> done{ false };
+
+		std::thread producer([&]
+		{
+			for (int n = 0; n < count; ++n)
+				push(q, n, n % 5 == 0);
+			done = true;
+		});
+
+		int last{ -1 };
+		size_t received{ 0 };
+		for (;;)
+		{
+			const auto finished{ done.load() };
+			for (auto n : pop_all(q))
+			{
+				CHECK(n > last);
+				last = n;
+				++received;
+			}
+			if (finished && q.empty())
+				break;
+			std::this_thread::sleep_for(consumer_pause);
+		}
+		producer.join();
+
+		CHECK(received + q.dropped_messages() ==
+			static_cast<size_t>(count));
+		if (p == policy::drop_oldest)
+			CHECK(last == count - 1);
+		if (p == policy::grow && limit >= static_cast<size_t>(count))
+			CHECK(q.dropped_messages() == 0);
+	}
+
+	// The consumer does not read until the producer has finished.
+	void drop_oldest_stalled_consumer()
+	{
+		midi_message_queue q(4, 4096, policy::drop_oldest);
+		for (int n = 0; n < 10; ++n)
+			CHECK(push(q, n));
+
+		CHECK((pop_all(q) == std::vector<int>{ 6, 7, 8, 9 }));
+		CHECK(q.dropped_messages() == 6);
+	}
+
+	// SysEx fill up the arena before the ring.
+	void drop_oldest_stalled_consumer_arena()
+	{
+		midi_message_queue q(64, 256, policy::drop_oldest);
+		for (int n = 0; n < 100; ++n)
+			CHECK(push(q, n, true));
+
+		const auto numbers{ pop_all(q) };
+		CHECK(!numbers.empty() && numbers.back() == 99);
+		CHECK(numbers.size() + q.dropped_messages() == 100);
+	}
+
+	// The producer evicts the oldest messages (drop_oldest) between
+	// the reads of the consumer, which never waits for it.
+	// A length or a message read is never one being overwritten.
+	void drop_oldest_evicts_while_reading()
+	{
+		midi_message_queue q(8, 256, policy::drop_oldest);
+		constexpr int count{ 16000 };
+		std::atomic<bool> done{ false };
+
+		std::thread producer([&]
+		{
+			for (int n = 0; n < count; ++n)
+				push(q, n, n % 3 == 0);
+			done = true;
+		});
+
+		int last{ -1 };
+		while (!done.load() || !q.empty())
+		{
+			const auto len{ q.front_length() };
+			CHECK(len == 0 || len == 3 || (len >= 9 && len < 9 + 64));
+			for (auto n : pop_all(q))
+			{
+				CHECK(n > last);
+				last = n;
+			}
+		}
+		producer.join();
+
+		CHECK(last == count - 1);
+	}
+
+	// The grow policy links and deletes segments while the producer
+	// replaces queued controllers in place.
+	// The latest value of each controller must always arrive.
+	void coalesce_while_growing()
+	{
+		midi_message_queue q(1 << 16, 4096, policy::grow);
+		q.set_coalesce_threshold(1);
+		constexpr int count{ 200000 };
+		std::atomic<bool> done{ false };
+
+		std::thread producer([&]
+		{
+			for (int n = 0; n < count; ++n)
+			{
+				const unsigned char cc[]{ 0xb0,
+					static_cast<unsigned char>(1 + n % 4),
+					static_cast<unsigned char>(n / 4 % 128) };
+				q.push(cc, sizeof(cc), n);
+				const auto note{ make_message(n, false) };
+				q.push(note.data(), note.size(), n);
+			}
+			done = true;
+		});
+
+		int values[4]{ -1, -1, -1, -1 };
+		for (;;)
+		{
+			const auto finished{ done.load() };
+			q.consume(std::numeric_limits<size_t>::max(),
+				[&](const unsigned char* data, size_t len, long long)
+			{
+				if (data[0] == 0xb0)
+				{
+					CHECK(len == 3 && data[1] >= 1 && data[1] <= 4);
+					values[data[1] - 1] = data[2];
+				}
+				return true;
+			});
+			if (finished && q.empty())
+				break;
+			std::this_thread::yield();
+		}
+		producer.join();
+
+		for (int i = 0; i < 4; ++i)
+			CHECK(values[i] == (count - 4 + i) / 4 % 128);
+		CHECK(q.dropped_messages() == 0);
+	}
+
+	void drop_newest_stalled_consumer()
+	{
+		midi_message_queue q(4, 4096, policy::drop_newest);
+		for (int n = 0; n < 10; ++n)
+			CHECK(push(q, n) == (n < 4));
+
+		CHECK((pop_all(q) == std::vector<int>{ 0, 1, 2, 3 }));
+		CHECK(q.dropped_messages() == 6);
+	}
+
+	// The limit is not rounded up to the ring capacity.
+	void drop_newest_limit()
+	{
+		midi_message_queue q(1000, 4096, policy::drop_newest);
+		for (int n = 0; n < 1500; ++n)
+			CHECK(push(q, n) == (n < 1000));
+
+		const auto numbers{ pop_all(q) };
+		CHECK(numbers.size() == 1000 && numbers.back() == 999);
+		CHECK(q.dropped_messages() == 500);
+	}
+}
+
+int main()
+{
+	using namespace std::chrono_literals;
+
+	drop_oldest_stalled_consumer();
+	drop_oldest_stalled_consumer_arena();
+	drop_oldest_evicts_while_reading();
+	drop_newest_stalled_consumer();
+	drop_newest_limit();
+	coalesce_while_growing();
+
+	for (auto p : { policy::drop_oldest, policy::drop_newest,
+		policy::keep_realtime_sysex, policy::grow })
+	{
+		synthetic_producer(p, 16384, 1 << 20, 10000, 0us);
+		synthetic_producer(p, 64, 4096, 10000, 100us);
+	}
+
+	return 0;
+}
@@ -0,0 +1,127 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_parser_bench.cpp:
+//   Throughput benchmark of midi_parser
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "midi_parser.h"
+
+#include "test.h"
+
+#include <random>
+
+using namespace uwp_midiio;
+
+namespace
+{
+	// Note on/off with running status and controllers
+	std::vector<unsigned char> channel_stream(size_t size)
+	{
+		std::mt19937 random(1);
+		std::vector<unsigned char> stream;
+		while (stream.size() < size)
+		{
+			if (random() % 4 == 0)
+				stream.push_back(random() % 2 ? 0x90 : 0xb0);
+			stream.push_back(static_cast<unsigned char>(random() & 0x7f));
+			stream.push_back(static_cast<unsigned char>(random() & 0x7f));
+		}
+		return stream;
+	}
+
+	// SysEx of 1 KiB with a clock every 256 bytes
+	std::vector<unsigned char> sysex_stream(size_t size)
+	{
+		std::vector<unsigned char> stream;
+		while (stream.size() < size)
+		{
+			stream.push_back(0xf0);
+			for (int i = 0; i < 1024; ++i)
+			{
+				if (i % 256 == 255)
+					stream.push_back(0xf8);
+				stream.push_back(static_cast<unsigned char>(i & 0x7f));
+			}
+			stream.push_back(0xf7);
+		}
+		return stream;
+	}
+
+	// Parses `stream` in slices of `slice` bytes `repeat` times.
+	void measure(const char* name, const std::vector<unsigned char>& stream,
+		size_t slice, int repeat)
+	{
+		size_t pieces{ 0 };
+		size_t checksum{ 0 };
+		const auto start{ std::chrono::steady_clock::now() };
+		for (int i = 0; i < repeat; ++i)
+		{
+			midi_parser parser;
+			for (size_t p = 0; p < stream.size(); p += slice)
+			{
+				const auto n{ std::min(slice, stream.size() - p) };
+				CHECK(parser.parse(stream.data() + p, n,
+					[&](const unsigned char* data, size_t len)
+					{
+						++pieces;
+						checksum += data[0] + len;
+						return true;
+					}) == n);
+			}
+		}
+		const std::chrono::duration<double> elapsed
+			{ std::chrono::steady_clock::now() - start };
+
+		std::printf("%-8s slice %6zu: %8.0f MB/s, %7.1f M pieces/s "
+			"(checksum %zx)\n", name, slice,
+			static_cast<double>(stream.size()) * repeat /
+			elapsed.count() / 1e6,
+			static_cast<double>(pieces) / elapsed.count() / 1e6,
+			checksum);
+	}
+}
+
+int main()
+{
+	const auto channel{ channel_stream(16 << 20) };
+	const auto sysex{ sysex_stream(16 << 20) };
+
+	for (size_t slice : { 3u, 64u, 4096u, 1u << 20 })
+	{
+		measure("channel", channel, slice, 4);
+		measure("sysex", sysex, slice, 4);
+	}
+
+	return 0;
+}
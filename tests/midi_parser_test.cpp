@@ -0,0 +1,220 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_parser_test.cpp:
+//   Tests of midi_parser
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "midi_parser.h"
+
+#include "test.h"
+
+#include <random>
+
+using namespace uwp_midiio;
+
+namespace
+{
+	using bytes = std::vector<unsigned char>;
+
+	std::vector<bytes> parse(midi_parser& parser, const bytes& data)
+	{
+		std::vector<bytes> pieces;
+		CHECK(parser.parse(data.data(), data.size(),
+			[&](const unsigned char* p, size_t len)
+			{
+				pieces.emplace_back(p, p + len);
+				return true;
+			}) == data.size());
+		return pieces;
+	}
+
+	// Rejects every message, so nothing of `data` is parsed
+	void reject(midi_parser& parser, const bytes& data)
+	{
+		CHECK(parser.parse(data.data(), data.size(),
+			[](const unsigned char*, size_t) { return false; }) == 0);
+	}
+
+	// Realtime in the middle leaves a lone EOX,
+	// which must be told apart from a short message.
+	void lone_eox()
+	{
+		midi_parser parser;
+		const auto pieces{ parse(parser,
+			{ 0xf0, 0x01, 0x02, 0x03, 0xf8, 0xf7, 0x90, 0x40, 0x7f }) };
+
+		CHECK((pieces == std::vector<bytes>{ { 0xf0, 0x01, 0x02, 0x03 },
+			{ 0xf8 }, { 0xf7 }, { 0x90, 0x40, 0x7f } }));
+		CHECK(is_sysex_piece(pieces[0].data()));
+		CHECK(!is_sysex_piece(pieces[1].data()));
+		CHECK(is_sysex_piece(pieces[2].data()));
+		CHECK(!is_sysex_piece(pieces[3].data()));
+		CHECK(!parser.in_sysex());
+	}
+
+	void running_status_across_calls()
+	{
+		midi_parser parser;
+		auto pieces{ parse(parser, { 0x90, 0x40 }) };
+		CHECK(pieces.empty());
+		pieces = parse(parser, { 0x7f, 0x41, 0x7f, 0x42 });
+		CHECK((pieces == std::vector<bytes>{ { 0x90, 0x40, 0x7f },
+			{ 0x90, 0x41, 0x7f } }));
+		pieces = parse(parser, { 0x00 });
+		CHECK((pieces == std::vector<bytes>{ { 0x90, 0x42, 0x00 } }));
+	}
+
+	// Giving the bytes again after a rejection completes a message
+	// whose first bytes were given in an earlier call.
+	void retry_after_rejection()
+	{
+		midi_parser parser;
+		CHECK(parse(parser, { 0xf2, 0x01 }).empty());
+		reject(parser, { 0x02, 0x90, 0x40, 0x7f });
+		auto pieces{ parse(parser, { 0x02, 0x90, 0x40, 0x7f }) };
+		CHECK((pieces == std::vector<bytes>{ { 0xf2, 0x01, 0x02 },
+			{ 0x90, 0x40, 0x7f } }));
+
+		CHECK(parse(parser, { 0x41 }).empty());
+		reject(parser, { 0x7f });
+		pieces = parse(parser, { 0x7f });
+		CHECK((pieces == std::vector<bytes>{ { 0x90, 0x41, 0x7f } }));
+	}
+
+	// 0xf0 at the start of a call ends the SysEx in progress
+	// and starts a new one, also when it is given again.
+	void sysex_after_unterminated_sysex()
+	{
+		midi_parser parser;
+		auto pieces{ parse(parser, { 0xf0, 0x01, 0x02 }) };
+		CHECK((pieces == std::vector<bytes>{ { 0xf0, 0x01, 0x02 } }));
+		CHECK(parser.in_sysex());
+
+		reject(parser, { 0xf0, 0x03, 0xf7 });
+		pieces = parse(parser, { 0xf0, 0x03, 0xf7 });
+		CHECK((pieces == std::vector<bytes>{ { 0xf0, 0x03, 0xf7 } }));
+		CHECK(!parser.in_sysex());
+
+		pieces = parse(parser, { 0xf0, 0x04 });
+		CHECK(parser.in_sysex());
+		pieces = parse(parser, { 0xf8, 0xf0, 0xf7 });
+		CHECK((pieces == std::vector<bytes>{ { 0xf8 }, { 0xf0, 0xf7 } }));
+		CHECK(!parser.in_sysex());
+	}
+
+	// A random stream given in random slices, with realtime messages
+	// inserted anywhere, comes out as the same messages.
+	void random_stream()
+	{
+		std::mt19937 random(1);
+
+		for (int round = 0; round < 200; ++round)
+		{
+			std::vector<bytes> messages;
+			bytes stream;
+			for (int i = 0; i < 200; ++i)
+			{
+				bytes m;
+				if (random() % 8 == 0)
+				{
+					m.push_back(0xf0);
+					const auto len{ random() % 300 };
+					for (size_t j = 0; j < len; ++j)
+						m.push_back(static_cast<unsigned char>(
+							random() & 0x7f));
+					m.push_back(0xf7);
+				}
+				else
+				{
+					const auto status{ static_cast<unsigned char>(
+						0x80 + random() % 0x70) };
+					m.push_back(status);
+					for (size_t j = 1; j < message_length(status); ++j)
+						m.push_back(static_cast<unsigned char>(
+							random() & 0x7f));
+				}
+				messages.push_back(m);
+
+				for (auto b : m)
+				{
+					if (random() % 50 == 0)
+						stream.push_back(0xf8);
+					stream.push_back(b);
+				}
+			}
+
+			midi_parser parser;
+			std::vector<bytes> received;
+			bool sysex{ false };
+			for (size_t p = 0; p < stream.size();)
+			{
+				const auto n{ std::min(stream.size() - p,
+					static_cast<size_t>(1 + random() % 100)) };
+				const bytes slice(stream.begin() + p,
+					stream.begin() + p + n);
+				for (const auto& piece : parse(parser, slice))
+				{
+					if (piece == bytes{ 0xf8 })
+						continue;
+					if (sysex)
+					{
+						// The rest of a SysEx
+						CHECK(is_sysex_piece(piece.data()) &&
+							piece[0] != 0xf0);
+						auto& m{ received.back() };
+						m.insert(m.end(), piece.begin(), piece.end());
+					}
+					else
+						received.push_back(piece);
+					sysex = received.back()[0] == 0xf0 &&
+						received.back().back() != 0xf7;
+				}
+				p += n;
+			}
+
+			CHECK(received == messages);
+		}
+	}
+}
+
+int main()
+{
+	lone_eox();
+	running_status_across_calls();
+	retry_after_rejection();
+	sysex_after_unterminated_sysex();
+	random_stream();
+
+	return 0;
+}
@@ -0,0 +1,146 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_port_in_test.cpp:
+//   Tests of MIDI IN ports on the fake backend
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "uwp_midiio.h"
+
+#include "test.h"
+
+namespace
+{
+	struct callback_record
+	{
+		std::mutex mtx;
+		std::condition_variable cv;
+		MIDIIn* handle{ nullptr };
+		long count{ 0 };
+	};
+
+	void UWP_MIDIIO_API on_messages(MIDIIn* pMIDIIn,
+		const unsigned char*, const long*, const long long*,
+		long lCount, void* pUser)
+	{
+		auto r{ static_cast<callback_record*>(pUser) };
+		std::lock_guard<std::mutex> lock(r->mtx);
+		r->handle = pMIDIIn;
+		r->count += lCount;
+		r->cv.notify_all();
+	}
+
+	// The callback gets the handle returned by the open function,
+	// which the application can pass back to the library.
+	void callback_gets_handle()
+	{
+		const auto p{ MIDIIn_OpenW(L"In A") };
+		CHECK(p);
+		callback_record r;
+		CHECK(MIDIIn_SetCallback(p, on_messages, &r) == 1);
+
+		fake_winrt::receive(L"in-a", { 0x90, 0x40, 0x7f });
+		{
+			std::unique_lock<std::mutex> lock(r.mtx);
+			r.cv.wait(lock, [&r] { return r.count == 1; });
+			CHECK(r.handle == p);
+		}
+
+		CHECK(MIDIIn_Close(p) == 1);
+	}
+
+	// Closing a port still connecting wakes up MIDIIn_WaitOpen
+	// waiting without a timeout in another thread.
+	void close_wakes_wait_open()
+	{
+		fake_winrt::get().open_delay_ms.store(500);
+		const auto p{ MIDIIn_OpenAsyncW(L"In A",
+			MIDIIO_OVERFLOW_DROP_OLDEST, 0, nullptr, nullptr) };
+		CHECK(p);
+
+		std::atomic<long> status{ -1 };
+		std::thread waiter{ [p, &status]
+		{
+			status.store(MIDIIn_WaitOpen(p, -1));
+		} };
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		CHECK(MIDIIn_Close(p) == 1);
+		waiter.join();
+		CHECK(status.load() == MIDIIO_STATUS_CLOSED ||
+			status.load() == MIDIIO_ERROR_INVALID_HANDLE);
+
+		fake_winrt::get().open_delay_ms.store(0);
+	}
+
+	void UWP_MIDIIO_API close_on_message(MIDIIn* pMIDIIn,
+		const unsigned char*, const long*, const long long*,
+		long lCount, void* pUser)
+	{
+		auto r{ static_cast<callback_record*>(pUser) };
+		const auto closed{ MIDIIn_Close(pMIDIIn) };
+		std::lock_guard<std::mutex> lock(r->mtx);
+		r->handle = pMIDIIn;
+		r->count += closed == 1 ? lCount : -1;
+		r->cv.notify_all();
+	}
+
+	// The callback can close its own port.
+	void close_from_callback()
+	{
+		const auto p{ MIDIIn_OpenW(L"In A") };
+		CHECK(p);
+		callback_record r;
+		CHECK(MIDIIn_SetCallback(p, close_on_message, &r) == 1);
+
+		fake_winrt::receive(L"in-a", { 0x90, 0x40, 0x7f });
+		{
+			std::unique_lock<std::mutex> lock(r.mtx);
+			r.cv.wait(lock, [&r] { return r.count != 0; });
+			CHECK(r.count == 1);
+		}
+
+		CHECK(MIDIIn_Close(p) == 0);
+		fake_winrt::receive(L"in-a", { 0x80, 0x40, 0x00 });
+	}
+}
+
+int main()
+{
+	fake_winrt::add_in_device(L"In A", L"in-a");
+
+	callback_gets_handle();
+	close_wakes_wait_open();
+	close_from_callback();
+
+	return 0;
+}
@@ -0,0 +1,314 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_port_out_test.cpp:
+//   Tests of MIDI OUT ports on the fake backend
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "uwp_midiio.h"
+
+#include "test.h"
+
+namespace
+{
+	using bytes = std::vector<unsigned char>;
+
+	// Bytes written to the fake device
+	class recorder
+	{
+	public:
+		recorder()
+		{
+			fake_winrt::set_on_send([this](std::wstring_view,
+				const unsigned char* data, uint32_t len)
+			{
+				std::lock_guard<std::mutex> lock(mtx_);
+				sent_.insert(sent_.end(), data, data + len);
+			});
+		}
+		~recorder()
+		{
+			fake_winrt::set_on_send(nullptr);
+		}
+
+		// Without realtime messages
+		bytes take()
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			bytes b;
+			for (auto c : sent_)
+				if (c < 0xf8)
+					b.push_back(c);
+			sent_.clear();
+			return b;
+		}
+
+	private:
+		std::mutex mtx_;
+		bytes sent_;
+	};
+
+	bytes make_sysex(size_t len)
+	{
+		bytes sysex(len, 0x55);
+		sysex.front() = 0xf0;
+		sysex.back() = 0xf7;
+		return sysex;
+	}
+
+	MIDIOut* open_async()
+	{
+		const auto p{ MIDIOut_OpenW(L"Out A") };
+		CHECK(p);
+		CHECK(MIDIOut_SetAsync(p, 1, 0) == 1);
+		return p;
+	}
+
+	// Puts the rest again while the queue is full
+	void put(MIDIOut* p, bytes message)
+	{
+		size_t queued{ 0 };
+		while (queued < message.size())
+		{
+			const auto n{ MIDIOut_PutMIDIMessage(p, message.data() + queued,
+				static_cast<long>(message.size() - queued)) };
+			CHECK(n >= 0 || n == MIDIIO_ERROR_QUEUE_FULL);
+			if (n > 0)
+				queued += static_cast<size_t>(n);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	// A SysEx larger than the queue arena is queued in pieces,
+	// so putting the rest again always makes progress.
+	void large_sysex()
+	{
+		recorder r;
+		const auto p{ open_async() };
+		const auto sysex{ make_sysex(1 << 20) };
+
+		put(p, sysex);
+		CHECK(MIDIOut_Flush(p, -1) == 1);
+		CHECK(r.take() == sysex);
+		CHECK(MIDIOut_Close(p) == 1);
+	}
+
+	// `sent` has `a` and `b` each in one piece, in either order
+	bool sent_whole(const bytes& sent, const bytes& a, const bytes& b)
+	{
+		auto ab{ a };
+		ab.insert(ab.end(), b.begin(), b.end());
+		auto ba{ b };
+		ba.insert(ba.end(), a.begin(), a.end());
+		return sent == ab || sent == ba;
+	}
+
+	// With the rate limiter, the note may go before a SysEx waiting
+	// in its lane, but never into it: neither before the EOX left alone
+	// by a realtime message nor between the pieces of a long SysEx.
+	void sysex_not_interrupted_by_lanes()
+	{
+		recorder r;
+		const auto p{ open_async() };
+		CHECK(MIDIOut_SetRateLimit(p, 10 * 1024 * 1024) == 1);
+
+		const bytes note{ 0x90, 0x40, 0x7f };
+		for (int i = 0; i < 20; ++i)
+		{
+			put(p, { 0xf0, 0x01, 0x02, 0x03, 0xf8, 0xf7 });
+			put(p, note);
+			CHECK(MIDIOut_Flush(p, -1) == 1);
+			CHECK(sent_whole(r.take(),
+				{ 0xf0, 0x01, 0x02, 0x03, 0xf7 }, note));
+		}
+
+		const auto sysex{ make_sysex(100 * 1024) };
+		for (int i = 0; i < 5; ++i)
+		{
+			put(p, sysex);
+			put(p, note);
+			CHECK(MIDIOut_Flush(p, -1) == 1);
+			CHECK(sent_whole(r.take(), sysex, note));
+		}
+
+		CHECK(MIDIOut_Close(p) == 1);
+	}
+
+	// A value that could not be sent is sent again,
+	// not dropped by the duplicate filter.
+	void filter_after_failed_send(long packing_window)
+	{
+		const auto p{ open_async() };
+		CHECK(MIDIOut_SetDuplicateFilter(p, 10 * 1000 * 1000, nullptr) == 1);
+		CHECK(MIDIOut_SetPacking(p, packing_window, 0) == 1);
+		const bytes volume{ 0xb0, 0x07, 0x64 };
+
+		fake_winrt::set_on_send([](std::wstring_view, const unsigned char*,
+			uint32_t)
+		{
+			throw winrt::hresult_error{};
+		});
+		put(p, volume);
+		CHECK(MIDIOut_Flush(p, -1) == 1);
+
+		recorder r;
+		put(p, volume);
+		CHECK(MIDIOut_Flush(p, -1) == 1);
+		CHECK(r.take() == volume);
+
+		CHECK(MIDIOut_Close(p) == 1);
+	}
+
+	// The duplicate filter of a port in synchronous mode
+	// can be used by several threads at once.
+	void sync_filter_from_threads()
+	{
+		const auto p{ MIDIOut_OpenW(L"Out A") };
+		CHECK(p);
+		CHECK(MIDIOut_SetDuplicateFilter(p, 10 * 1000 * 1000, nullptr) == 1);
+
+		std::vector<std::thread> threads;
+		for (unsigned char channel = 0; channel < 4; ++channel)
+		{
+			threads.emplace_back([p, channel]
+			{
+				for (int i = 0; i < 1000; ++i)
+				{
+					bytes volume{ static_cast<unsigned char>(0xb0 | channel),
+						0x07, static_cast<unsigned char>(i % 4) };
+					CHECK(MIDIOut_PutMIDIMessage(p, volume.data(), 3) == 3);
+				}
+			});
+		}
+		for (auto& t : threads)
+			t.join();
+
+		CHECK(MIDIOut_Close(p) == 1);
+	}
+
+	// A port whose queue becomes full partway through the message
+	// reports how much of it was queued.
+	void multi_partial_queue()
+	{
+		const auto a{ MIDIOut_OpenW(L"Out A") };
+		CHECK(a);
+		CHECK(MIDIOut_SetAsync(a, 1, 4) == 1);
+		const auto b{ MIDIOut_OpenW(L"Out B") };
+		CHECK(b);
+
+		// The sender thread of Out A stops in the first write.
+		std::atomic<bool> blocked{ false };
+		std::atomic<bool> release{ false };
+		std::mutex mtx;
+		bytes sent_a;
+		fake_winrt::set_on_send([&](std::wstring_view id,
+			const unsigned char* data, uint32_t len)
+		{
+			if (id != L"out-a")
+				return;
+			blocked.store(true);
+			while (!release.load())
+				std::this_thread::yield();
+			std::lock_guard<std::mutex> lock(mtx);
+			sent_a.insert(sent_a.end(), data, data + len);
+		});
+		bytes note{ 0x90, 0x40, 0x7f };
+		CHECK(MIDIOut_PutMIDIMessage(a, note.data(), 3) == 3);
+		while (!blocked.load())
+			std::this_thread::yield();
+
+		bytes notes;
+		for (unsigned char key = 0; key < 64; ++key)
+			notes.insert(notes.end(), { 0x90, key, 0x7f });
+		MIDIOut* ports[]{ a, nullptr, b };
+		long results[3]{};
+		CHECK(MIDIOut_PutMIDIMessageMulti(ports, 3, notes.data(),
+			static_cast<long>(notes.size()), results) == 1);
+		CHECK(results[0] > 0 &&
+			results[0] < static_cast<long>(notes.size()) &&
+			results[0] % 3 == 0);
+		CHECK(results[1] == 0);
+		CHECK(results[2] == static_cast<long>(notes.size()));
+
+		release.store(true);
+		CHECK(MIDIOut_Flush(a, -1) == 1);
+		fake_winrt::set_on_send(nullptr);
+		note.insert(note.end(), notes.begin(), notes.begin() + results[0]);
+		CHECK(sent_a == note);
+
+		CHECK(MIDIOut_Close(a) == 1);
+		CHECK(MIDIOut_Close(b) == 1);
+	}
+
+	// A scheduled message is never sent early,
+	// whether the sender thread spins or not.
+	void scheduled_not_early(long spin_margin)
+	{
+		const auto p{ open_async() };
+		CHECK(MIDIOut_SetScheduleSpin(p, spin_margin) == 1);
+
+		std::atomic<long long> sent_time{ 0 };
+		fake_winrt::set_on_send([&sent_time](std::wstring_view,
+			const unsigned char*, uint32_t)
+		{
+			sent_time.store(MIDIIO_GetTime());
+		});
+		bytes note{ 0x90, 0x40, 0x7f };
+		const auto due{ MIDIIO_GetTime() + 20 * 1000 };
+		CHECK(MIDIOut_PutMIDIMessageAt(p, note.data(),
+			static_cast<long>(note.size()), due) == 3);
+		CHECK(MIDIOut_Flush(p, -1) == 1);
+		CHECK(sent_time.load() >= due);
+
+		fake_winrt::set_on_send(nullptr);
+		CHECK(MIDIOut_Close(p) == 1);
+	}
+}
+
+int main()
+{
+	fake_winrt::add_out_device(L"Out A", L"out-a");
+	fake_winrt::add_out_device(L"Out B", L"out-b");
+
+	large_sysex();
+	sysex_not_interrupted_by_lanes();
+	filter_after_failed_send(0);
+	filter_after_failed_send(1000);
+	sync_filter_from_threads();
+	multi_partial_queue();
+	scheduled_not_early(0);
+	scheduled_not_early(1000);
+
+	return 0;
+}
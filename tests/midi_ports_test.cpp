@@ -0,0 +1,195 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_ports_test.cpp:
+//   Tests of opening and closing ports on the fake backend
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "uwp_midiio.h"
+
+#include "test.h"
+
+namespace
+{
+	// Fails the test if `f` does not return within `timeout`
+	template<class F>
+	void within(std::chrono::seconds timeout, F f)
+	{
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool done{ false };
+		std::thread watchdog{ [&]
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			if (!cv.wait_for(lock, timeout, [&done] { return done; }))
+			{
+				std::fprintf(stderr, "timed out\n");
+				std::_Exit(1);
+			}
+		} };
+		f();
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			done = true;
+		}
+		cv.notify_all();
+		watchdog.join();
+	}
+
+	// Receives, sends, closes and reopens ports on several threads,
+	// so that the calls in progress race with closing.
+	// Calls with a closed handle must fail without touching the port.
+	void put_get_close_reopen()
+	{
+		std::atomic<MIDIIn*> in{ MIDIIn_OpenW(L"In A") };
+		std::atomic<MIDIOut*> out{ MIDIOut_OpenW(L"Out A") };
+		CHECK(in.load());
+		CHECK(out.load());
+		std::atomic<bool> stop{ false };
+		std::vector<std::thread> threads;
+
+		threads.emplace_back([&stop]
+		{
+			while (!stop.load())
+				fake_winrt::receive(L"in-a", { 0x90, 0x40, 0x7f });
+		});
+		// One receiver and one sender per port as the API requires
+		threads.emplace_back([&stop, &in]
+		{
+			unsigned char buff[3];
+			while (!stop.load())
+			{
+				const auto p{ in.load() };
+				MIDIIn_WaitMIDIMessage(p, 1);
+				const auto n{ MIDIIn_GetMIDIMessage(p, buff, 3) };
+				CHECK(n == 0 || n == 3);
+			}
+		});
+		threads.emplace_back([&stop, &out]
+		{
+			unsigned char note[]{ 0x90, 0x40, 0x7f };
+			while (!stop.load())
+			{
+				const auto n{ MIDIOut_PutMIDIMessage(out.load(), note, 3) };
+				CHECK(n == 3 || n == 0 || n == MIDIIO_ERROR_QUEUE_FULL);
+			}
+		});
+
+		for (int i = 0; i < 30; ++i)
+		{
+			in.store(MIDIIn_ReopenW(in.load(), L"In A"));
+			CHECK(in.load());
+			const auto p{ MIDIOut_ReopenW(out.load(), L"Out A") };
+			CHECK(p);
+			// Before the sender can see it
+			if (i % 2)
+				CHECK(MIDIOut_SetAsync(p, 1, 0) == 1);
+			out.store(p);
+		}
+
+		stop.store(true);
+		for (auto& t : threads)
+			t.join();
+		CHECK(MIDIIn_Close(in.load()) == 1);
+		CHECK(MIDIOut_Close(out.load()) == 1);
+	}
+
+	// Closing a port does not wait for the other ports
+	// that block in receiving, flushing or connecting.
+	void close_while_other_ports_wait()
+	{
+		const auto in_b{ MIDIIn_OpenW(L"In B") };
+		CHECK(in_b);
+		const auto out_b{ MIDIOut_OpenW(L"Out B") };
+		CHECK(out_b);
+		CHECK(MIDIOut_SetAsync(out_b, 1, 0) == 1);
+		CHECK(MIDIOut_SetRateLimit(out_b, 30) == 1);
+		unsigned char note[]{ 0x90, 0x40, 0x7f };
+		for (int i = 0; i < 100; ++i)
+			CHECK(MIDIOut_PutMIDIMessage(out_b, note, 3) == 3);
+		fake_winrt::get().open_delay_ms.store(60 * 1000);
+		const auto connecting{ MIDIIn_OpenAsyncW(L"In B",
+			MIDIIO_OVERFLOW_DROP_OLDEST, 0, nullptr, nullptr) };
+		CHECK(connecting);
+
+		std::vector<std::thread> waiters;
+		waiters.emplace_back([in_b] { MIDIIn_WaitMIDIMessage(in_b, -1); });
+		waiters.emplace_back([out_b] { MIDIOut_Flush(out_b, -1); });
+		waiters.emplace_back([connecting]
+		{
+			MIDIIn_WaitOpen(connecting, -1);
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		fake_winrt::get().open_delay_ms.store(0);
+
+		within(std::chrono::seconds(30), put_get_close_reopen);
+
+		CHECK(MIDIIn_Close(in_b) == 1);
+		CHECK(MIDIOut_Close(out_b) == 1);
+		CHECK(MIDIIn_Close(connecting) == 1);
+		for (auto& t : waiters)
+			t.join();
+	}
+
+	// MIDIIO_OpenPorts finds a device connected after the devices
+	// were enumerated.
+	void open_ports_finds_new_device()
+	{
+		const auto out_a{ MIDIOut_OpenW(L"Out A") };
+		CHECK(out_a);
+		CHECK(MIDIOut_Close(out_a) == 1);
+		fake_winrt::add_out_device(L"Out C", L"out-c");
+
+		const wchar_t* names[]{ L"Out C" };
+		MIDIOut* outs[1]{};
+		long status[1]{};
+		CHECK(MIDIIO_OpenPorts(names, 1, outs, status,
+			nullptr, 0, nullptr, nullptr, -1) == 1);
+		CHECK(status[0] == MIDIIO_STATUS_OPEN);
+		CHECK(MIDIOut_Close(outs[0]) == 1);
+	}
+}
+
+int main()
+{
+	fake_winrt::add_in_device(L"In A", L"in-a");
+	fake_winrt::add_out_device(L"Out A", L"out-a");
+	fake_winrt::add_in_device(L"In B", L"in-b");
+	fake_winrt::add_out_device(L"Out B", L"out-b");
+
+	put_get_close_reopen();
+	close_while_other_ports_wait();
+	open_ports_finds_new_device();
+
+	return 0;
+}
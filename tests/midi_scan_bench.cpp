@@ -0,0 +1,88 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_scan_bench.cpp:
+//   Benchmark of find_status (SIMD) and find_status_scalar
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "midi_scan.h"
+
+#include "test.h"
+
+#include <cinttypes>
+
+using namespace uwp_midiio;
+
+namespace
+{
+	// Scans `sysex` for its EOX `repeat` times
+	// and returns the throughput in MB/s.
+	template<class F>
+	double measure(F find, const std::vector<unsigned char>& sysex,
+		int repeat)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+		for (int i = 0; i < repeat; ++i)
+		{
+			// After F0
+			const auto eox{ find(sysex.data() + 1,
+				sysex.data() + sysex.size()) };
+			CHECK(eox == sysex.data() + sysex.size() - 1);
+		}
+		const std::chrono::duration<double> elapsed
+			{ std::chrono::steady_clock::now() - start };
+
+		return static_cast<double>(sysex.size()) * repeat /
+			elapsed.count() / 1e6;
+	}
+}
+
+int main()
+{
+	for (size_t size : { 1u << 20, 4u << 20, 16u << 20 })
+	{
+		std::vector<unsigned char> sysex(size, 0x55);
+		sysex.front() = 0xf0;
+		sysex.back() = 0xf7;
+		const int repeat{ static_cast<int>((256u << 20) / size) };
+
+		const auto simd{ measure(find_status, sysex, repeat) };
+		const auto scalar{ measure(find_status_scalar, sysex, repeat) };
+
+		std::printf("SysEx %3zu MiB: find_status %8.0f MB/s, "
+			"find_status_scalar %8.0f MB/s (x%.1f)\n",
+			size >> 20, simd, scalar, simd / scalar);
+	}
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+//
+// UWP MIDIIO Library (DLL) that enables using BLE MIDI devices for Sekaiju
+// https://github.com/trueroad/uwp_midiio
+//
+// midi_scan_test.cpp:
+//   Tests of find_status against the scalar scan
+//
+// Copyright (C) 2022 Masamichi Hosoda.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include "pch.h"
+
+#include "midi_scan.h"
+
+#include "test.h"
+
+#include <random>
+
+using namespace uwp_midiio;
+
+int main()
+{
+	std::mt19937 random(1);
+	std::vector<unsigned char> buffer(4096);
+
+	for (int i = 0; i < 20000; ++i)
+	{
+		// Data bytes with a few status bytes at random positions
+		for (auto& b : buffer)
+			b = static_cast<unsigned char>(random() & 0x7f);
+		const auto statuses{ random() % 3 };
+		for (size_t j = 0; j < statuses; ++j)
+			buffer[random() % buffer.size()] |= 0x80;
+
+		const auto first{ random() % 64 };
+		const auto last{ first + random() % (buffer.size() - first) };
+		const auto p{ buffer.data() + first };
+		const auto end{ buffer.data() + last };
+
+		CHECK(find_status(p, end) == find_status_scalar(p, end));
+	}
+
+	return 0;
+}